@@ -0,0 +1,432 @@
+/*
+ *  Bucket storage layouts for the separate chaining hashtable
+ */
+
+#ifndef __BUCKET_STORAGE_H
+#define __BUCKET_STORAGE_H
+
+#include <vector>
+#include <list>
+#include <memory>
+#include <utility>
+#include <cstddef>
+
+#include "PoolAllocator.h"
+#include "HashIterator.h"
+
+//
+// A bucket storage owns the chains of a ChainingHash, the table only decides which bucket a key goes in.
+// Every storage has the same members:
+//   void assign( int n )                                 --> Drops everything and makes n empty buckets
+//   int size( )                                          --> Number of buckets
+//   pair<K,V>* find( int b, const Q& key, int& probes )  --> First entry for key in bucket b, or nullptr
+//   int count( int b, const Q& key, int& probes )        --> Number of entries for key in bucket b
+//   void push( int b, const pair<K,V>& p )               --> Adds p to bucket b
+//   bool erase( int b, const Q& key, int& probes )       --> Removes the first entry for key from bucket b, false if there was none
+//   int bucket_size( int b )                             --> Number of entries in bucket b
+//   void prefetch( int b )                               --> Starts pulling bucket b into the cache, never faults
+//   iterator begin( int b )                              --> First entry in bucket b or a later one
+//   iterator end( )                                      --> Past the last entry
+//   void clear( )                                        --> Drops every bucket and hands pooled memory back
+//   void rehash( int n, F bucketOf )                     --> Moves every entry into n buckets, bucketOf(key) gives its new bucket
+// find, count and erase add the number of entries they compared against key to probes. Q is any type
+// that compares to K with ==, so heterogeneous lookups reach the storage without building a K.
+//
+// Tables take the storage as a template template parameter after the allocator, e.g.
+//   ChainingHash<int, int, std::hash<int>, PrimeModulo, PoolAllocator<pair<int,int>>, InlineBuckets>
+//
+
+//
+// One std::list per bucket, the original layout. Every bucket pays for a list header and every
+// lookup follows at least one pointer into a separately allocated node.
+//
+template<typename K, typename V, typename Alloc>
+class ListBuckets {
+private:
+    typedef std::list<std::pair<K,V>, Alloc> Bucket;
+
+    std::vector<Bucket> array;
+    Alloc alloc;
+
+public:
+    void assign(int n) {
+        array.assign(n, Bucket(alloc)); //every bucket shares the one allocator
+    }
+
+    int size() {
+        return array.size();
+    }
+
+    template<typename Q>
+    std::pair<K,V>* find(int b, const Q& key, int& probes) {
+        for (auto & listElement : array[b]){ //iterate through the list at the hash location
+            probes++;
+            if (listElement.first == key)
+                return &listElement;
+        }
+        return nullptr;
+    }
+
+    template<typename Q>
+    int count(int b, const Q& key, int& probes) {
+        int num = 0;
+        for (auto & listElement : array[b]){
+            probes++;
+            if (listElement.first == key)
+                num++; //increment total if keys are the same
+        }
+        return num;
+    }
+
+    void push(int b, const std::pair<K,V>& p) {
+        array[b].push_back(p); //push new pair to back of list at hash location
+    }
+
+    template<typename Q>
+    bool erase(int b, const Q& key, int& probes) {
+        for (auto it = array[b].begin(); it != array[b].end(); ++it){
+            probes++;
+            if (it->first == key){
+                array[b].erase(it); //get rid of the element that matches the given key
+                return true;
+            }
+        }
+        return false;
+    }
+
+    int bucket_size(int b) {
+        return array[b].size();
+    }
+
+    // Forward iterator over every entry, bucket by bucket (see HashIterator.h)
+    class iterator {
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef std::pair<K,V> value_type;
+        typedef std::pair<const K&, V&> reference;
+        typedef ArrowProxy<reference> pointer;
+        typedef std::ptrdiff_t difference_type;
+
+        iterator() : buckets(nullptr), b(0), n(0) {}
+        iterator(std::vector<Bucket>* buckets, int b) : buckets(buckets), b(b), n(buckets->size()) {
+            skipEmpty();
+        }
+
+        reference operator*() const { return reference(it->first, it->second); }
+        pointer operator->() const { return pointer{**this}; }
+
+        iterator& operator++() {
+            if (++it == (*buckets)[b].end()){ //end of this list, on to the next bucket that has one
+                b++;
+                skipEmpty();
+            }
+            return *this;
+        }
+
+        iterator operator++(int) {
+            iterator old = *this;
+            ++*this;
+            return old;
+        }
+
+        bool operator==(const iterator& other) const { return b == other.b && (b == n || it == other.it); }
+        bool operator!=(const iterator& other) const { return !(*this == other); }
+
+        int bucket() const { return b; }
+
+    private:
+        void skipEmpty() {
+            while (b < n && (*buckets)[b].empty())
+                b++;
+            if (b < n)
+                it = (*buckets)[b].begin();
+        }
+
+        std::vector<Bucket>* buckets;
+        int b, n;
+        typename Bucket::iterator it;
+    };
+
+    iterator begin(int b) {
+        return iterator(&array, b);
+    }
+
+    iterator end() {
+        return iterator(&array, array.size());
+    }
+
+    void prefetch(int b) { //only the list header, the first node is another miss behind it
+        __builtin_prefetch(&array[b]);
+    }
+
+    void clear() {
+        for (auto &list : array){
+            list.clear();
+        }
+        array.clear();
+        release_pool(alloc); //a pooled allocator frees all of its node blocks at once
+    }
+
+    template<typename F>
+    void rehash(int n, F bucketOf) {
+        std::vector<Bucket> oldArray;
+        oldArray.swap(array); //take the buckets out without copying them
+        array.resize(n, Bucket(alloc));
+
+        for (auto& oldList : oldArray){
+            while (!oldList.empty()){ //relink every node into its new bucket, nothing is copied or allocated
+                Bucket& newList = array[bucketOf(oldList.front().first)];
+                newList.splice(newList.end(), oldList, oldList.begin());
+            }
+        }
+    }
+};
+
+//
+// The first entry of every bucket is stored inline in the bucket array, only the second and later
+// entries go in a singly-linked chain of nodes. Below a load factor of 1 most buckets hold zero or
+// one entry, so a lookup usually reads the one slot and never follows a pointer.
+// Chain nodes come from Alloc (rebound to the node type), pass PoolAllocator to get them from a NodePool.
+//
+template<typename K, typename V, typename Alloc>
+class InlineBuckets {
+private:
+    struct Node {
+        std::pair<K,V> entry;
+        Node* next;
+    };
+
+    struct Slot {
+        std::pair<K,V> entry; //only meaningful when full
+        Node* next; //overflow chain, always nullptr when the slot isn't full
+        bool full;
+
+        Slot() : next(nullptr), full(false) {}
+    };
+
+    typedef typename std::allocator_traits<Alloc>::template rebind_alloc<Node> NodeAlloc;
+    typedef std::allocator_traits<NodeAlloc> NodeTraits;
+
+    std::vector<Slot> slots;
+    NodeAlloc alloc;
+
+public:
+    InlineBuckets() {}
+
+    InlineBuckets(const InlineBuckets&) = delete; //the chains are owned by the slots
+    InlineBuckets& operator=(const InlineBuckets&) = delete;
+
+    ~InlineBuckets() {
+        clear();
+    }
+
+    void assign(int n) {
+        clear();
+        slots.resize(n);
+    }
+
+    int size() {
+        return slots.size();
+    }
+
+    template<typename Q>
+    std::pair<K,V>* find(int b, const Q& key, int& probes) {
+        Slot& slot = slots[b];
+        if (!slot.full)
+            return nullptr;
+        probes++;
+        if (slot.entry.first == key) //the common case, no pointer chase
+            return &slot.entry;
+        for (Node* node = slot.next; node; node = node->next){
+            probes++;
+            if (node->entry.first == key)
+                return &node->entry;
+        }
+        return nullptr;
+    }
+
+    template<typename Q>
+    int count(int b, const Q& key, int& probes) {
+        Slot& slot = slots[b];
+        if (!slot.full)
+            return 0;
+        probes++;
+        int num = slot.entry.first == key ? 1 : 0;
+        for (Node* node = slot.next; node; node = node->next){
+            probes++;
+            if (node->entry.first == key)
+                num++;
+        }
+        return num;
+    }
+
+    void push(int b, const std::pair<K,V>& p) {
+        Slot& slot = slots[b];
+        if (!slot.full){
+            slot.entry = p;
+            slot.full = true;
+        }
+        else
+            slot.next = newNode(p, slot.next); //push onto the front of the chain, no walk needed
+    }
+
+    template<typename Q>
+    bool erase(int b, const Q& key, int& probes) {
+        Slot& slot = slots[b];
+        if (!slot.full)
+            return false;
+        probes++;
+        if (slot.entry.first == key){
+            if (Node* node = slot.next){ //pull the first chained entry inline so the slot stays full
+                slot.entry = std::move(node->entry);
+                slot.next = node->next;
+                deleteNode(node);
+            }
+            else
+                slot.full = false;
+            return true;
+        }
+        for (Node** link = &slot.next; *link; link = &(*link)->next){
+            probes++;
+            if ((*link)->entry.first == key){
+                Node* node = *link;
+                *link = node->next;
+                deleteNode(node);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    int bucket_size(int b) {
+        int num = slots[b].full ? 1 : 0;
+        for (Node* node = slots[b].next; node; node = node->next)
+            num++;
+        return num;
+    }
+
+    // Forward iterator over every entry, each slot's inline entry first and then its chain (see HashIterator.h)
+    class iterator {
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef std::pair<K,V> value_type;
+        typedef std::pair<const K&, V&> reference;
+        typedef ArrowProxy<reference> pointer;
+        typedef std::ptrdiff_t difference_type;
+
+        iterator() : slots(nullptr), b(0), n(0), node(nullptr) {}
+        iterator(std::vector<Slot>* slots, int b) : slots(slots), b(b), n(slots->size()), node(nullptr) {
+            skipEmpty();
+        }
+
+        reference operator*() const {
+            std::pair<K,V>& entry = node ? node->entry : (*slots)[b].entry;
+            return reference(entry.first, entry.second);
+        }
+
+        pointer operator->() const { return pointer{**this}; }
+
+        iterator& operator++() {
+            node = node ? node->next : (*slots)[b].next;
+            if (!node){ //end of this slot's chain, a slot with a chain is always full so the next full slot is next
+                b++;
+                skipEmpty();
+            }
+            return *this;
+        }
+
+        iterator operator++(int) {
+            iterator old = *this;
+            ++*this;
+            return old;
+        }
+
+        bool operator==(const iterator& other) const { return b == other.b && node == other.node; }
+        bool operator!=(const iterator& other) const { return !(*this == other); }
+
+        int bucket() const { return b; }
+
+    private:
+        void skipEmpty() {
+            while (b < n && !(*slots)[b].full)
+                b++;
+        }
+
+        std::vector<Slot>* slots;
+        int b, n;
+        Node* node; //nullptr while on the slot's inline entry
+    };
+
+    iterator begin(int b) {
+        return iterator(&slots, b);
+    }
+
+    iterator end() {
+        return iterator(&slots, slots.size());
+    }
+
+    void prefetch(int b) { //the slot holds the first entry, so this is usually the whole lookup
+        __builtin_prefetch(&slots[b]);
+    }
+
+    void clear() {
+        for (auto& slot : slots){
+            for (Node* node = slot.next; node; ){
+                Node* next = node->next;
+                deleteNode(node);
+                node = next;
+            }
+        }
+        slots.clear();
+        release_pool(alloc); //a pooled allocator frees all of its node blocks at once
+    }
+
+    template<typename F>
+    void rehash(int n, F bucketOf) {
+        std::vector<Slot> oldSlots;
+        oldSlots.swap(slots); //take the slots out without copying them
+        slots.resize(n);
+
+        for (auto& old : oldSlots){
+            if (!old.full)
+                continue;
+            Slot& slot = slots[bucketOf(old.entry.first)];
+            if (!slot.full){
+                slot.entry = std::move(old.entry);
+                slot.full = true;
+            }
+            else
+                slot.next = newNode(std::move(old.entry), slot.next);
+
+            for (Node* node = old.next; node; ){ //chained nodes are relinked as they are, unless they can go inline
+                Node* next = node->next;
+                Slot& target = slots[bucketOf(node->entry.first)];
+                if (!target.full){
+                    target.entry = std::move(node->entry);
+                    target.full = true;
+                    deleteNode(node);
+                }
+                else {
+                    node->next = target.next;
+                    target.next = node;
+                }
+                node = next;
+            }
+        }
+    }
+
+private:
+    template<typename P>
+    Node* newNode(P&& p, Node* next) {
+        Node* node = NodeTraits::allocate(alloc, 1);
+        NodeTraits::construct(alloc, node, Node{std::forward<P>(p), next});
+        return node;
+    }
+
+    void deleteNode(Node* node) {
+        NodeTraits::destroy(alloc, node);
+        NodeTraits::deallocate(alloc, node, 1);
+    }
+};
+
+#endif //__BUCKET_STORAGE_H
@@ -0,0 +1,275 @@
+/*
+ *  Streaming loader that fills a table from a file of key/value pairs
+ */
+
+#ifndef __BULK_LOADER_H
+#define __BULK_LOADER_H
+
+#include <vector>
+#include <string>
+#include <future>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <omp.h>
+
+// File formats load_file reads
+enum LoadFormat {
+    LOAD_BINARY = 0, //packed records: the sizeof(K) bytes of the key, then the sizeof(V) bytes of the value
+    LOAD_CSV = 1     //one "key,value" pair per line, blank lines are skipped
+};
+
+//
+// Reads a file front to back in chunks of a fixed size. While the caller works on one chunk the
+// next one is already being read on another thread, so there are never more than two in memory.
+// Throws std::runtime_error if the file can't be opened or read.
+//
+class ChunkReader {
+public:
+    ChunkReader(const std::string& path, size_t chunkBytes) : current(0) {
+        fd = ::open(path.c_str(), O_RDONLY);
+        if (fd == -1)
+            throw std::runtime_error("Can't open " + path + ": " + std::strerror(errno));
+        ::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL); //have the kernel read ahead as well
+        buffers[0].resize(chunkBytes);
+        buffers[1].resize(chunkBytes);
+        pending = std::async(std::launch::async, &ChunkReader::fill, this, 0);
+    }
+
+    ~ChunkReader() {
+        if (pending.valid())
+            pending.wait();
+        ::close(fd);
+    }
+
+    ChunkReader(const ChunkReader&) = delete;
+    ChunkReader& operator=(const ChunkReader&) = delete;
+
+    // Returns the next chunk as (data, length), with length 0 once the whole file has been read.
+    // The chunk stays valid until the next call.
+    std::pair<const char*, size_t> next() {
+        if (!pending.valid())
+            return std::pair<const char*, size_t>(nullptr, 0);
+        size_t length = pending.get(); //rethrows a failed read
+        int ready = current;
+        current ^= 1;
+        if (length == buffers[ready].size()) //a short chunk is the end of the file
+            pending = std::async(std::launch::async, &ChunkReader::fill, this, current); //the buffer the caller just finished with
+        return std::pair<const char*, size_t>(buffers[ready].data(), length);
+    }
+
+private:
+    size_t fill(int b) { //reads until the buffer is full or the file ends
+        std::vector<char>& buffer = buffers[b];
+        size_t length = 0;
+        while (length < buffer.size()){
+            ssize_t got = ::read(fd, buffer.data() + length, buffer.size() - length);
+            if (got < 0 && errno == EINTR)
+                continue;
+            if (got < 0)
+                throw std::runtime_error(std::string("Read failed: ") + std::strerror(errno));
+            if (got == 0)
+                break;
+            length += got;
+        }
+        return length;
+    }
+
+    int fd;
+    std::vector<char> buffers[2];
+    int current; //buffer being filled by pending
+    std::future<size_t> pending;
+};
+
+// Parses the CSV field [first, last) into value, false if it isn't a valid one
+template<typename T>
+typename std::enable_if<std::is_integral<T>::value, bool>::type parseField(const char* first, const char* last, T& value) {
+    bool negative = first < last && *first == '-';
+    if (first < last && (*first == '-' || *first == '+'))
+        first++;
+    if (first == last)
+        return false;
+    unsigned long long n = 0;
+    for (; first < last; first++){
+        if (*first < '0' || *first > '9')
+            return false;
+        n = n * 10 + (*first - '0');
+    }
+    value = negative ? (T)(0 - n) : (T)n;
+    return true;
+}
+
+template<typename T>
+typename std::enable_if<std::is_floating_point<T>::value, bool>::type parseField(const char* first, const char* last, T& value) {
+    char text[64]; //strtod needs a terminated string
+    size_t length = last - first;
+    if (length == 0 || length >= sizeof text)
+        return false;
+    std::memcpy(text, first, length);
+    text[length] = '\0';
+    char* end;
+    value = std::strtod(text, &end);
+    return end == text + length;
+}
+
+inline bool parseField(const char* first, const char* last, std::string& value) {
+    value.assign(first, last);
+    return true;
+}
+
+// Copies a LOAD_BINARY record into pair, only possible when the bytes are all there is to K and V
+template<typename K, typename V>
+typename std::enable_if<std::is_trivially_copyable<K>::value && std::is_trivially_copyable<V>::value>::type
+decodeBinary(const char* record, std::pair<K, V>& pair) {
+    std::memcpy(&pair.first, record, sizeof(K));
+    std::memcpy(&pair.second, record + sizeof(K), sizeof(V));
+}
+
+template<typename K, typename V>
+typename std::enable_if<!(std::is_trivially_copyable<K>::value && std::is_trivially_copyable<V>::value)>::type
+decodeBinary(const char*, std::pair<K, V>&) {} //never called, load_file turns these down before reading
+
+inline void trimField(const char*& first, const char*& last) { //drops spaces, tabs and a Windows line ending
+    while (first < last && (*first == ' ' || *first == '\t'))
+        first++;
+    while (last > first && (last[-1] == ' ' || last[-1] == '\t' || last[-1] == '\r'))
+        last--;
+}
+
+// Parses the record [first, last) into pair, false if it doesn't parse
+template<typename K, typename V>
+bool decodeRecord(const char* first, const char* last, LoadFormat format, std::pair<K, V>& pair) {
+    if (format == LOAD_BINARY){
+        decodeBinary(first, pair);
+        return true;
+    }
+    const char* comma = static_cast<const char*>(std::memchr(first, ',', last - first));
+    if (!comma)
+        return false;
+    const char* keyFirst = first, * keyLast = comma, * valueFirst = comma + 1, * valueLast = last;
+    trimField(keyFirst, keyLast);
+    trimField(valueFirst, valueLast);
+    return parseField(keyFirst, keyLast, pair.first) && parseField(valueFirst, valueLast, pair.second);
+}
+
+//
+// Streams the file at path into table, chunkBytes of the file at a time, and returns the number of
+// pairs loaded.
+//  - the records of a chunk are split out on the calling thread (one cut off at the end of a chunk
+//    is finished with the start of the next), then parsed and hashed on all the OpenMP threads
+//  - every chunk goes into the table through insert_batch with the hashes already worked out, which
+//    prefetches on the single threaded tables and inserts in parallel on the concurrent ones
+// Memory use is two chunks of the file plus one chunk of parsed pairs, whatever the size of the file.
+// Throws std::runtime_error on a read error or a record that doesn't parse, the pairs before it stay loaded.
+//
+template<typename Table>
+long load_file(Table& table, const std::string& path, LoadFormat format, size_t chunkBytes = 4 << 20) {
+    typedef typename Table::key_type K;
+    typedef typename Table::mapped_type V;
+    const size_t recordBytes = sizeof(K) + sizeof(V);
+    if (format == LOAD_BINARY && !(std::is_trivially_copyable<K>::value && std::is_trivially_copyable<V>::value))
+        throw std::runtime_error("LOAD_BINARY needs trivially copyable keys and values");
+    ChunkReader reader(path, std::max(chunkBytes, recordBytes));
+    typename Table::hasher hashFunction = table.hash_function();
+
+    std::string carry; //the start of a record that was cut off at the end of the last chunk
+    std::vector<std::pair<const char*, const char*>> records; //[first, last) of every whole record in the chunk
+    std::vector<std::pair<K, V>> pairs;
+    std::vector<size_t> hashes;
+    long loaded = 0;
+    for (;;){
+        std::pair<const char*, size_t> chunk = reader.next();
+        const char* data = chunk.first, * end = data + chunk.second;
+        bool last = chunk.second == 0;
+        records.clear();
+
+        // Finish the carried record with the start of this chunk
+        if (format == LOAD_CSV){
+            const char* newline = last ? end : static_cast<const char*>(std::memchr(data, '\n', end - data));
+            if (!last && !newline){ //a line longer than a whole chunk
+                carry.append(data, end);
+                continue;
+            }
+            if (!carry.empty() || !last){
+                carry.append(data, newline);
+                data = newline == end ? end : newline + 1;
+            }
+        }
+        else if (!carry.empty()){
+            size_t needed = std::min(recordBytes - carry.size(), (size_t)(end - data));
+            carry.append(data, needed);
+            data += needed;
+            if (carry.size() < recordBytes){
+                if (last)
+                    throw std::runtime_error(path + " ends in the middle of a record");
+                continue;
+            }
+        }
+        if (!carry.empty())
+            records.push_back(std::make_pair(carry.data(), carry.data() + carry.size()));
+
+        // Every whole record left in the chunk
+        const char* tail = data;
+        if (format == LOAD_CSV){
+            const char* newline;
+            while (tail < end && (newline = static_cast<const char*>(std::memchr(tail, '\n', end - tail)))){
+                records.push_back(std::make_pair(tail, newline));
+                tail = newline + 1;
+            }
+        }
+        else {
+            for (; (size_t)(end - tail) >= recordBytes; tail += recordBytes)
+                records.push_back(std::make_pair(tail, tail + recordBytes));
+        }
+
+        int n = records.size(), bad = n;
+        pairs.resize(n);
+        hashes.resize(n);
+        #pragma omp parallel for schedule(static)
+        for (int i = 0; i < n; i++){
+            const char* first = records[i].first, * lastByte = records[i].second;
+            if (format == LOAD_CSV){
+                const char* trimmedFirst = first, * trimmedLast = lastByte;
+                trimField(trimmedFirst, trimmedLast);
+                if (trimmedFirst == trimmedLast){ //blank line, cleared here and dropped below
+                    records[i].first = nullptr;
+                    continue;
+                }
+            }
+            if (decodeRecord(first, lastByte, format, pairs[i]))
+                hashes[i] = hashFunction(pairs[i].first);
+            else {
+                #pragma omp critical
+                bad = std::min(bad, i);
+            }
+        }
+
+        int kept = 0; //squeeze out blank lines, and everything from the first bad record on
+        for (int i = 0; i < bad; i++){
+            if (records[i].first){
+                if (kept != i) //a self move would empty a string key
+                    pairs[kept] = std::move(pairs[i]);
+                hashes[kept++] = hashes[i];
+            }
+        }
+        table.insert_batch(pairs.data(), hashes.data(), kept);
+        loaded += kept;
+        if (bad < n)
+            throw std::runtime_error("Can't parse \"" + std::string(records[bad].first, records[bad].second) + "\" in " + path);
+
+        if (last){
+            if (format == LOAD_BINARY && tail != end)
+                throw std::runtime_error(path + " ends in the middle of a record");
+            return loaded;
+        }
+        carry.assign(tail, end); //records now point at data we no longer need
+    }
+}
+
+#endif //__BULK_LOADER_H
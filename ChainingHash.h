@@ -15,6 +15,10 @@
 
 // Custom project includes
 #include "Hash.h"
+#include "HashPolicy.h"
+#include "PoolAllocator.h"
+#include "BucketStorage.h"
+#include "HashStats.h"
 
 // Namespaces to include
 using std::vector;
@@ -25,15 +29,24 @@ using std::cout;
 using std::endl;
 
 //
-// Separate chaining based hash table - derived from Hash
+// Separate chaining based hash table - derived from StaticHash
+//  HashFn is the hash functor and Reduce is the policy that maps a hash onto a bucket (see HashPolicy.h)
+//  Alloc allocates the chain nodes, PoolAllocator<pair<K,V>> hands them out of large blocks (see PoolAllocator.h)
+//  Storage is the bucket layout: ListBuckets keeps a std::list per bucket, InlineBuckets keeps the
+//  first entry in the bucket array itself (see BucketStorage.h)
 //
-template<typename K, typename V>
-class ChainingHash : public Hash<K,V> {
-private:
-
+template<typename K, typename V, typename HashFn = std::hash<K>, typename Reduce = PrimeModulo,
+         typename Alloc = std::allocator<pair<K,V>>,
+         template<typename, typename, typename> class Storage = ListBuckets>
+class ChainingHash : public StaticHash<ChainingHash<K,V,HashFn,Reduce,Alloc,Storage>, K, V> {
 public:
-    ChainingHash(int n = 101) {
-        array.resize(n);
+    typedef HashFn hasher;
+    typedef typename Storage<K, V, Alloc>::iterator iterator; //see HashIterator.h
+
+    ChainingHash(int n = 101) : limits(0.75, false) {
+        n = reduce.bucketsFor(n);
+        array.assign(n);
+        reduce.resize(n);
         s = 0;
     }
 
@@ -42,7 +55,7 @@ public:
     }
 
     bool empty() {
-        return array.empty();
+        return array.size() == 0;
     }
 
     int size() {
@@ -50,32 +63,25 @@ public:
     }
 
     V& at(const K& key) {
-        for (auto & listElement : array[hash(key)]){ //iterate through the list at the hash location
-            if (listElement.first == key)
-                return listElement.second; // only returns value if key is in the list
-        }
-        //throw std::out_of_range("Key not in hash");
-        cout << "Key not in hash" << endl;
-        //return key;
+        return valueOf(find(key, hashFunction(key)));
+    }
+
+    template<typename Q>
+    typename IfTransparent<HashFn, Q, V&>::type at(const Q& key) {
+        return valueOf(find(key, hashFunction(key)));
     }
 
     V& operator[](const K& key) {
-        for (auto & listElement : array[hash(key)]){ //iterate through the list at the hash location
-            if (listElement.first == key)
-                return listElement.second; // only returns value if key is in the list
-        }
-        //throw std::out_of_range("Key not in hash");
-        cout << "Key not in hash" << endl;
-        //return key;
+        return at(key);
     }
 
     int count(const K& key) {
-        int num = 0;
-        for (auto & listElement : array[hash(key)]){ //iterate through the list at the hash location
-            if (listElement.first == key)
-                num++; //increment total if keys are the same
-        }
-        return num; //return total
+        return count_with_hash(key, hashFunction(key));
+    }
+
+    template<typename Q>
+    typename IfTransparent<HashFn, Q, int>::type count(const Q& key) {
+        return count_with_hash(key, hashFunction(key));
     }
 
     void emplace(K key, V value) {
@@ -83,113 +89,170 @@ public:
     }
 
     void insert(const std::pair<K, V>& pair) {
-        array[hash(pair.first)].push_back(pair); //push new pair to back of list at hash location
-        s++;
-        if (load_factor() > 0.75) 
-            rehash(); // rehash if load factor is above threshold
+        insert_with_hash(pair, hashFunction(pair.first));
     }
 
     void erase(const K& key) {
-        for (auto & listElement : array[hash(key)]){ //iterate through the list at the hash location
-            if (listElement.first == key){
-                array[hash(key)].remove(listElement); //get rid of the element that matches the given key
-                break;
-            }
-        }
-        s--;
+        erase_with_hash(key, hashFunction(key));
+    }
+
+    template<typename Q>
+    typename IfTransparent<HashFn, Q, void>::type erase(const Q& key) {
+        erase_with_hash(key, hashFunction(key));
     }
 
     void clear() {
-        for (auto &list : array){
-            list.clear();
-        }
         array.clear();
         s = 0;
     }
 
     int bucket_count() {
-        return array.capacity();
+        return array.size();
     }
 
     int bucket_size(int n) {
-        return array[n].size();
+        return array.bucket_size(n);
     }
 
     int bucket(const K& key) {
-        for (auto & listElement : array[hash(key)]){ //iterate through the list at the hash location
-            if (listElement.first == key)
-                return hash(key); // only returns bucket number if it is in the list
-        }
-        throw std::out_of_range("Key not in hash"); // throw exception if not in list
+        return bucket_with_hash(key, hashFunction(key));
+    }
+
+    template<typename Q>
+    typename IfTransparent<HashFn, Q, int>::type bucket(const Q& key) {
+        return bucket_with_hash(key, hashFunction(key));
     }
 
     float load_factor() {
-        return ((float)s/(float)array.capacity());
+        return ((float)s/(float)array.size());
     }
 
     void rehash() {
-        vector<list<pair<K,V>>> oldArray = array;
+        rehash(limits.grown(bucket_count(), s + 1)); //grow by the growth factor
+    }
 
-        array.resize(findNextPrime(2 * array.capacity())); //double size then find next prime
+    void rehash(int n) {
+        HASH_STATS_ONLY(counters.rehashed(); RehashTimer timer(counters));
+        n = reduce.bucketsFor(n); //round given value up to a size the policy supports
+        reduce.resize(n);
+        array.rehash(n, [this](const K& key) { return hash(key); }); //entries are moved, not copied
+    }
 
-        for (auto& list : array) //clear table
-            list.clear();
-        
-        s = 0; //reset size
+    void reserve(int n) {
+        int needed = limits.bucketsFor(n); //buckets needed to hold n elements without going over the max load factor
+        if (needed > bucket_count())
+            rehash(needed);
+    }
 
-        for (auto& oldList : oldArray){ //iterate through the linked lists
-            for (auto& oldItem : oldList) //iterate through the items in the linked list
-                insert(std::move(oldItem)); //move the items into the newly resized table
-        }
+    HashStats stats() {
+        HashStats stats;
+        HASH_STATS_ONLY(counters.fill(stats));
+        for (int b = 0; b < bucket_count(); b++)
+            stats.chainLengths[array.bucket_size(b)]++;
+        return stats;
     }
 
-    void rehash(int n) {
-        vector<list<pair<K,V>>> oldArray = array;
+    iterator begin() {
+        return array.begin(0);
+    }
+
+    iterator end() {
+        return array.end();
+    }
+
+    HashFn hash_function() {
+        return hashFunction;
+    }
+
+    // Lookups and inserts with a hash the caller already has, h must be hash_function()(key). Callers that
+    // hash a key once for several tables, or keep the hash next to the key, skip hashing it again.
+    // find_with_hash returns the key's value, or nullptr.
+    template<typename Q>
+    V* find_with_hash(const Q& key, size_t h) {
+        pair<K,V>* entry = find(key, h);
+        return entry ? &entry->second : nullptr;
+    }
 
-        array.resize(findNextPrime(n)); //find next prime after given value
+    void insert_with_hash(const std::pair<K, V>& pair, size_t h) {
+        if (limits.overfull(s + 1, bucket_count()))
+            rehash(); // rehash if load factor would go above threshold, also gives a cleared table its buckets back
+        array.push(reduce(h), pair);
+        s++;
+    }
 
-        for (auto& list : array) //clear table
-            list.clear();
-        
-        s = 0; //reset size
+    template<typename Q>
+    int count_with_hash(const Q& key, size_t h) {
+        if (bucket_count() == 0) //cleared, reduce still maps onto the old bucket count
+            return 0;
+        int probes = 0, num = array.count(reduce(h), key, probes);
+        HASH_STATS_ONLY(counters.lookup(num > 0, probes));
+        return num;
+    }
+
+    template<typename Q>
+    int bucket_with_hash(const Q& key, size_t h) {
+        if (!find(key, h))
+            throw std::out_of_range("Key not in hash"); // throw exception if not in the bucket
+        return reduce(h); // only returns bucket number if it is in the bucket
+    }
 
-        for (auto& oldList : oldArray){ //iterate through the linked lists
-            for (auto& oldItem : oldList) //iterate through the items in the linked list
-                insert(std::move(oldItem)); //move the items into the newly resized table
+    template<typename Q>
+    void erase_with_hash(const Q& key, size_t h) {
+        if (bucket_count() == 0)
+            return;
+        int probes = 0;
+        bool erased = array.erase(reduce(h), key, probes); //get rid of the element that matches the given key
+        HASH_STATS_ONLY(counters.lookup(erased, probes));
+        if (erased){
+            s--;
+            if (limits.underfull(s, bucket_count()))
+                shrink();
         }
     }
 
+    void prefetch(size_t h) { //see StaticHash::find_batch
+        if (bucket_count() > 0)
+            array.prefetch(reduce(h));
+    }
 
 private:
+    friend class StaticHash<ChainingHash, K, V>;
 
-    vector<list<pair<K,V>>> array;
+    Storage<K, V, Alloc> array;
     int s; //keeps track of the size (number of filled buckets)
+    HashFn hashFunction;
+    Reduce reduce;
+    LoadPolicy limits; //see HashPolicy.h
+    HASH_STATS_ONLY(StatsCounters counters;)
+
+    template<typename Q>
+    pair<K,V>* find(const Q& key, size_t h) { //also behind at, find_with_hash and bucket_with_hash
+        if (bucket_count() == 0) //cleared, reduce still maps onto the old bucket count
+            return nullptr;
+        int probes = 0;
+        pair<K,V>* entry = array.find(reduce(h), key, probes);
+        HASH_STATS_ONLY(counters.lookup(entry != nullptr, probes));
+        return entry;
+    }
 
-    int findNextPrime(int n)
-    {
-        while (!isPrime(n))
-        {
-            n++;
-        }
-        return n;
+    V& valueOf(pair<K,V>* entry) {
+        if (!entry)
+            throw std::out_of_range("Key not in hash");
+        return entry->second; // only returns value if key is in the bucket
     }
 
-    int isPrime(int n)
-    {
-        for (int i = 2; i <= sqrt(n); i++)
-        {
-            if (n % i == 0)
-            {
-                return false;
-            }
-        }
+    void shrink() { //only if the policy rounds the smaller size to fewer buckets than there are now
+        int n = reduce.bucketsFor(limits.shrunk(s));
+        if (n < bucket_count())
+            rehash(n);
+    }
 
-        return true;
+    iterator iteratorAt(int b) { //first pair in bucket b or after it, for StaticHash::parallel_for_each
+        return array.begin(b);
     }
 
     int hash(const K& key) {
-        std::hash<K> hashFunction;
-        return hashFunction(key) % this->bucket_count();    
+        return reduce(hashFunction(key));
     }
 
 };
@@ -0,0 +1,513 @@
+#ifndef __CUCKOO_HASH_H
+#define __CUCKOO_HASH_H
+
+#include <vector>
+#include <stdexcept>
+#include <cstdint>
+#include <functional>
+#include <algorithm>
+#include <utility>
+#include <new>
+#include <cstdlib>
+
+#include "Hash.h"
+#include "HashPolicy.h"
+#include "HashStats.h"
+#include "HashIterator.h"
+
+using std::vector;
+using std::pair;
+
+//
+// Cuckoo hash table with bounded lookups - derived from StaticHash
+//  - every key has two candidate buckets, taken from the two halves of its mixed hash, and every bucket
+//    holds SLOTS pairs next to each other, starting on a cache line. A lookup compares at most 2 * SLOTS
+//    keys in those two buckets, there is no chain or cluster to walk. When a bucket fits in a line (int
+//    keys and values do) that is two cache lines, up to four while a resize is in progress since the old
+//    buckets are searched too, plus the stash's lines while it holds anything
+//  - an insert that finds both buckets full moves a pair out of one of them to that pair's other bucket
+//    (a kick), up to MAX_KICKS times. If that doesn't free a slot the pair goes in a small stash that
+//    lookups only search while it isn't empty, and only a full stash makes the table rebuild bigger
+//  - growing and shrinking is incremental: the old buckets are kept next to the new ones and every insert
+//    and erase moves MIGRATE_STEP of them over, lookups check both until the last one has moved, so no
+//    single insert pays for a whole rehash. rehash(), begin() and stats() finish a resize in progress
+//  - keys are unique, inserting a key that is already there replaces its value (the other tables keep both)
+//  Buckets as the Hash interface counts them (bucket_count, bucket_size, bucket) are slots, numbered
+//  bucket by bucket with the stash's slots last. at() returns a reference into the table, it stays
+//  valid until the next insert or erase.
+//  HashFn is the hash functor, its result is always mixed before use, so there is no Reduce policy
+//
+template<typename K, typename V, typename HashFn = std::hash<K>>
+class CuckooHash : public StaticHash<CuckooHash<K,V,HashFn>, K, V> { // derived from StaticHash
+private:
+    static const int SLOTS = 4; //pairs per bucket
+    static const int STASH_BUCKETS = 2; //the stash is this many buckets after the last hashed one
+    static const int MAX_KICKS = 128; //pairs moved by one insert before it gives up and uses the stash
+    static const int MIGRATE_STEP = 8; //old buckets moved over by every insert and erase while resizing
+    static const int CACHE_LINE = 64;
+
+    struct alignas(CACHE_LINE) Bucket {
+        unsigned char used; //bit i is set when slot i holds a pair
+        K keys[SLOTS];
+        V values[SLOTS];
+
+        Bucket() : used(0), keys(), values() {}
+    };
+
+    // std::allocator only guarantees alignof(max_align_t) before C++17, so the buckets are allocated
+    // through this to keep every one of them on its own cache line(s)
+    template<typename T>
+    struct LineAllocator {
+        typedef T value_type;
+
+        LineAllocator() {}
+        template<typename U>
+        LineAllocator(const LineAllocator<U>&) {}
+
+        T* allocate(size_t n) {
+            void* p;
+            if (posix_memalign(&p, CACHE_LINE, n * sizeof(T)) != 0)
+                throw std::bad_alloc();
+            return static_cast<T*>(p);
+        }
+
+        void deallocate(T* p, size_t) {
+            free(p);
+        }
+
+        template<typename U>
+        bool operator==(const LineAllocator<U>&) const { return true; }
+        template<typename U>
+        bool operator!=(const LineAllocator<U>&) const { return false; }
+    };
+
+    // The buckets keys hash to, then the stash. While resizing there are two of these.
+    struct Table {
+        vector<Bucket, LineAllocator<Bucket>> buckets;
+        int n; //buckets a key can hash to, the stash isn't counted
+        int stashed; //pairs in the stash
+
+        Table(int n = 0) : buckets(n + STASH_BUCKETS), n(n), stashed(0) {}
+
+        int first(uint64_t m) const { //high half of the mixed hash onto [0, n) (fastrange)
+            return ((m >> 32) * n) >> 32;
+        }
+
+        int second(uint64_t m) const { //low half
+            return ((m & 0xFFFFFFFF) * n) >> 32;
+        }
+    };
+
+    Table table; //every new pair goes here
+    Table old; //what is left of the table before a resize, moved into table a few buckets at a time
+    bool resizing;
+    int migrated; //buckets of old that have been moved so far, the stash's included
+    int s; //size of table
+    uint32_t kickState; //picks the slot an insert kicks a pair out of
+    HashFn hashFunction;
+    LoadPolicy limits; //see HashPolicy.h, the load counts the hashed slots
+    HASH_STATS_ONLY(StatsCounters counters;)
+
+    friend class StaticHash<CuckooHash, K, V>;
+    friend class SlotIterator<CuckooHash, K, V>;
+
+public:
+    typedef HashFn hasher;
+    typedef SlotIterator<CuckooHash, K, V> iterator; //see HashIterator.h
+
+    CuckooHash(int n = 101) : table(bucketsFor(n)), resizing(false), migrated(0), s(0), kickState(1), limits(0.9, true) {}
+
+    ~CuckooHash() {
+        this->clear();
+    }
+
+    bool empty() {
+        return table.n == 0;
+    }
+
+    int size() {
+        return s;
+    }
+
+    V& at(const K& key) {
+        return valueAt(find(key, mix(key)));
+    }
+
+    template<typename Q>
+    typename IfTransparent<HashFn, Q, V&>::type at(const Q& key) {
+        return valueAt(find(key, mix(key)));
+    }
+
+    V& operator[](const K& key) {
+        return at(key);
+    }
+
+    int count(const K& key) {
+        return count_with_hash(key, hashFunction(key));
+    }
+
+    template<typename Q>
+    typename IfTransparent<HashFn, Q, int>::type count(const Q& key) {
+        return count_with_hash(key, hashFunction(key));
+    }
+
+    void emplace(K key, V value) {
+        insert({key,value}); //use insert as helper
+    }
+
+    void insert(const std::pair<K, V>& pair) {
+        insert_with_hash(pair, hashFunction(pair.first));
+    }
+
+    void erase(const K& key) {
+        erase_with_hash(key, hashFunction(key));
+    }
+
+    template<typename Q>
+    typename IfTransparent<HashFn, Q, void>::type erase(const Q& key) {
+        erase_with_hash(key, hashFunction(key));
+    }
+
+    void clear() {
+        table = Table();
+        old = Table();
+        resizing = false;
+        migrated = 0;
+        s = 0;
+    }
+
+    int bucket_count() { //in slots, the stash's included
+        return table.buckets.size() * SLOTS;
+    }
+
+    int bucket_size(int n) {
+        return table.buckets[n / SLOTS].used >> (n % SLOTS) & 1;
+    }
+
+    int bucket(const K& key) {
+        return bucket_with_hash(key, hashFunction(key));
+    }
+
+    template<typename Q>
+    typename IfTransparent<HashFn, Q, int>::type bucket(const Q& key) {
+        return bucket_with_hash(key, hashFunction(key));
+    }
+
+    float load_factor() {
+        return ((float)s/(float)bucket_count());
+    }
+
+    void rehash() {
+        rehash(limits.grown(table.n * SLOTS, s + 1));
+    }
+
+    // Resizes to at least n slots straight away, finishing a resize in progress
+    void rehash(int n) {
+        rebuild(bucketsFor(n));
+    }
+
+    void reserve(int n) {
+        int needed = limits.bucketsFor(n); //slots needed to hold n elements without going over the max load factor
+        if (needed > table.n * SLOTS)
+            rehash(needed);
+    }
+
+    HashStats stats() {
+        finishResize();
+        HashStats stats;
+        HASH_STATS_ONLY(counters.fill(stats));
+        for (int b = 0; b < table.n; b++) //pairs per bucket --> number of buckets
+            stats.chainLengths[__builtin_popcount(table.buckets[b].used)]++;
+        return stats;
+    }
+
+    iterator begin() {
+        finishResize(); //so every pair is in table
+        return iteratorAt(0);
+    }
+
+    iterator end() {
+        return iterator(this, bucket_count());
+    }
+
+    HashFn hash_function() {
+        return hashFunction;
+    }
+
+    // Lookups and inserts with a hash the caller already has, h must be hash_function()(key). Callers that
+    // hash a key once for several tables, or keep the hash next to the key, skip hashing it again.
+    // find_with_hash returns the key's value, or nullptr.
+    template<typename Q>
+    V* find_with_hash(const Q& key, size_t h) {
+        return find(key, mix64(h));
+    }
+
+    void insert_with_hash(const std::pair<K, V>& pair, size_t h) {
+        uint64_t m = mix64(h);
+        if (V* value = find(pair.first, m)){ //keys are unique, replace the value
+            *value = pair.second;
+            return;
+        }
+        if (limits.overfull(s + 1, table.n * SLOTS)) //also gives a cleared table its buckets back
+            startResize(bucketsFor(limits.grown(table.n * SLOTS, s + 1)));
+        else if (resizing)
+            migrate();
+        add(pair.first, pair.second, m);
+        s++;
+    }
+
+    template<typename Q>
+    int count_with_hash(const Q& key, size_t h) {
+        return find(key, mix64(h)) ? 1 : 0;
+    }
+
+    template<typename Q>
+    int bucket_with_hash(const Q& key, size_t h) {
+        return bucketWithHash(key, mix64(h));
+    }
+
+    template<typename Q>
+    void erase_with_hash(const Q& key, size_t h) {
+        Table* t;
+        int slot;
+        if (!locate(key, mix64(h), t, slot))
+            return; //nothing to erase, like unordered_map::erase
+        t->buckets[slot / SLOTS].used &= ~(1u << slot % SLOTS);
+        if (slot >= t->n * SLOTS)
+            t->stashed--;
+        s--;
+        if (resizing)
+            migrate();
+        else if (limits.underfull(s, table.n * SLOTS) && bucketsFor(limits.shrunk(s)) < table.n)
+            startResize(bucketsFor(limits.shrunk(s)));
+    }
+
+    void prefetch(size_t h) { //see StaticHash::find_batch, both buckets since a lookup may need either
+        if (table.n == 0)
+            return;
+        uint64_t m = mix64(h);
+        __builtin_prefetch(&table.buckets[table.first(m)]);
+        __builtin_prefetch(&table.buckets[table.second(m)]);
+    }
+
+private:
+    static int bucketsFor(int n) { //buckets that give at least n slots
+        return std::max((n + SLOTS - 1) / SLOTS, 1);
+    }
+
+    template<typename Q>
+    uint64_t mix(const Q& key) {
+        return mix64(hashFunction(key));
+    }
+
+    // Finds key in table, or in old while resizing. t and slot are set to where it is. m is the mixed hash.
+    template<typename Q>
+    bool locate(const Q& key, uint64_t m, Table*& t, int& slot) {
+        int probes = 0;
+        if (search(table, key, m, slot, probes))
+            t = &table;
+        else if (resizing && search(old, key, m, slot, probes))
+            t = &old;
+        else {
+            HASH_STATS_ONLY(counters.lookup(false, probes));
+            return false;
+        }
+        HASH_STATS_ONLY(counters.lookup(true, probes));
+        return true;
+    }
+
+    template<typename Q>
+    V* find(const Q& key, uint64_t m) {
+        Table* t;
+        int slot;
+        return locate(key, m, t, slot) ? &t->buckets[slot / SLOTS].values[slot % SLOTS] : nullptr;
+    }
+
+    // The two buckets, then the stash if anything is in it. probes counts the keys compared.
+    template<typename Q>
+    bool search(Table& t, const Q& key, uint64_t m, int& slot, int& probes) {
+        if (t.n == 0)
+            return false;
+        int b1 = t.first(m), b2 = t.second(m);
+        if (searchBucket(t, b1, key, slot, probes) || (b2 != b1 && searchBucket(t, b2, key, slot, probes)))
+            return true;
+        for (int b = t.n; t.stashed > 0 && b < t.n + STASH_BUCKETS; b++)
+            if (searchBucket(t, b, key, slot, probes))
+                return true;
+        return false;
+    }
+
+    template<typename Q>
+    bool searchBucket(Table& t, int b, const Q& key, int& slot, int& probes) {
+        Bucket& bucket = t.buckets[b];
+        for (unsigned used = bucket.used; used; used &= used - 1){ //walk the set bits
+            int i = __builtin_ctz(used);
+            probes++;
+            if (bucket.keys[i] == key){
+                slot = b * SLOTS + i;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    V& valueAt(V* value) {
+        if (!value)
+            throw std::out_of_range("Key not in hash");
+        return *value;
+    }
+
+    template<typename Q>
+    int bucketWithHash(const Q& key, uint64_t m) {
+        finishResize(); //slots are only numbered in table
+        Table* t;
+        int slot;
+        if (!locate(key, m, t, slot))
+            throw std::out_of_range("Key not in hash");
+        return slot;
+    }
+
+    // Adds a pair that isn't in the table yet, rebuilding it bigger in the rare case there is no room
+    void add(K key, V value, uint64_t m) {
+        if (!place(table, key, value, m)){
+            vector<pair<K,V>> homeless(1, pair<K,V>(std::move(key), std::move(value)));
+            rebuild(bucketsFor(limits.grown(table.n * SLOTS, s + 1)), std::move(homeless));
+        }
+    }
+
+    // Puts key in one of its two buckets in t, kicking pairs out to their other bucket while both are full,
+    // then in the stash. Returns false if even the stash is full, key and value then hold the pair that
+    // still has no slot, which isn't always the one passed in.
+    bool place(Table& t, K& key, V& value, uint64_t m) {
+        int b = t.first(m);
+        if (fill(t.buckets[b], key, value) || fill(t.buckets[t.second(m)], key, value))
+            return true;
+        for (int kick = 0; kick < MAX_KICKS; kick++){
+            kickState = kickState * 1103515245 + 12345; //a random slot, so kicks don't go round in a cycle
+            int i = (kickState >> 16) % SLOTS;
+            std::swap(key, t.buckets[b].keys[i]);
+            std::swap(value, t.buckets[b].values[i]);
+            uint64_t kicked = mix(key);
+            int b1 = t.first(kicked);
+            b = b == b1 ? t.second(kicked) : b1; //the kicked out pair's other bucket
+            if (fill(t.buckets[b], key, value))
+                return true;
+        }
+        for (int stash = t.n; stash < t.n + STASH_BUCKETS; stash++){
+            if (fill(t.buckets[stash], key, value)){
+                t.stashed++;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool fill(Bucket& bucket, K& key, V& value) { //takes a free slot in bucket, false if it's full
+        unsigned free = ~bucket.used & ((1u << SLOTS) - 1);
+        if (!free)
+            return false;
+        int i = __builtin_ctz(free);
+        bucket.keys[i] = std::move(key);
+        bucket.values[i] = std::move(value);
+        bucket.used |= 1u << i;
+        return true;
+    }
+
+    // Starts moving every pair into a table of n buckets, see migrate
+    void startResize(int n) {
+        finishResize(); //one resize at a time
+        HASH_STATS_ONLY(counters.rehashed());
+        old = std::move(table);
+        table = Table(n);
+        resizing = true;
+        migrated = 0;
+    }
+
+    // Moves the next MIGRATE_STEP buckets of old into table, the stash last, and drops old after the last one
+    void migrate() {
+        HASH_STATS_ONLY(RehashTimer timer(counters));
+        int last = std::min(migrated + MIGRATE_STEP, old.n + STASH_BUCKETS);
+        for (; migrated < last; migrated++){
+            Bucket& bucket = old.buckets[migrated];
+            while (bucket.used){
+                int i = __builtin_ctz(bucket.used);
+                bucket.used &= ~(1u << i);
+                uint64_t m = mix(bucket.keys[i]);
+                add(std::move(bucket.keys[i]), std::move(bucket.values[i]), m);
+                if (!resizing)
+                    return; //add had to rebuild, which moved everything that was left
+            }
+        }
+        if (migrated == old.n + STASH_BUCKETS){
+            old = Table();
+            resizing = false;
+        }
+    }
+
+    void finishResize() {
+        while (resizing)
+            migrate();
+    }
+
+    // Moves every pair (old's as well) and the extra ones into a new table of n buckets all at once, and
+    // keeps growing it until they all fit. Only used by rehash and by an insert that found no slot anywhere.
+    void rebuild(int n, vector<pair<K,V>> pairs = vector<pair<K,V>>()) {
+        HASH_STATS_ONLY(counters.rehashed(); RehashTimer timer(counters));
+        takeAll(table, pairs);
+        takeAll(old, pairs);
+        old = Table();
+        resizing = false;
+        migrated = 0;
+        for (;; n = bucketsFor(limits.grown(n * SLOTS, pairs.size()))){
+            Table bigger(n);
+            bool fits = true;
+            for (int i = 0; fits && i < (int)pairs.size(); i++){
+                K key = pairs[i].first; //copies, a failed attempt leaves pairs as it was
+                V value = pairs[i].second;
+                fits = place(bigger, key, value, mix(pairs[i].first));
+            }
+            if (fits){
+                table = std::move(bigger);
+                return;
+            }
+        }
+    }
+
+    void takeAll(Table& t, vector<pair<K,V>>& pairs) {
+        for (auto& bucket : t.buckets){
+            for (unsigned used = bucket.used; used; used &= used - 1){
+                int i = __builtin_ctz(used);
+                pairs.push_back(pair<K,V>(std::move(bucket.keys[i]), std::move(bucket.values[i])));
+            }
+            bucket.used = 0;
+        }
+        t.stashed = 0;
+    }
+
+    iterator iteratorAt(int b) { //first pair in bucket b or after it
+        return iterator(this, nextFull(b));
+    }
+
+    int nextFull(int index) { //a bucket at a time, with its used bits
+        int n = bucket_count();
+        while (index < n){
+            int b = index / SLOTS;
+            unsigned full = table.buckets[b].used >> (index % SLOTS);
+            if (full)
+                return index + __builtin_ctz(full);
+            index = (b + 1) * SLOTS;
+        }
+        return n;
+    }
+
+    K& slotKey(int index) {
+        return table.buckets[index / SLOTS].keys[index % SLOTS];
+    }
+
+    V& slotValue(int index) {
+        return table.buckets[index / SLOTS].values[index % SLOTS];
+    }
+
+};
+
+#endif //__CUCKOO_HASH_H
@@ -10,12 +10,21 @@
 #ifndef __Hash_H
 #define __Hash_H
 
+#include <iterator>
+#include <utility>
+#include <algorithm>
+#include <cstddef>
+#include <omp.h>
+
+#include "HashStats.h"
+
 // Hash class interface notes
 // ******************PUBLIC OPERATIONS*********************
 // bool empty( )                            --> Test for empty hash
 // int size( )                              --> Quantity of (non-deleted) elements in hash
 // V& at( const K& k )                      --> Returns the value with key k
 // V& operator[]( const K& k )              --> Returns the value with key k
+// bool lookup( const K& k, V& value )      --> Copies the value with key k into value, false if k isn't in the hash
 // int count( const K& key )                --> Returns the number of elements with key k
 // bool emplace ( const K& key, V& value )  --> Adds element with key, true if successful
 // bool insert( const pair<K, V>& pair )    --> Adds pair to hash, true if successful
@@ -27,15 +36,29 @@
 // float load_factor( )                     --> Returns the load factor of the hash
 // void rehash( int n )                     --> Resizes the hash to contain at least n buckets
 //                                              Resizes to next prime starting from n and going up
+// void reserve( int n )                    --> Resizes the hash so n elements fit without going over the max load factor
+// float max_load_factor( ), void max_load_factor( float f )  --> Load that makes the hash grow (see LoadPolicy in HashPolicy.h)
+// float growth_factor( ), void growth_factor( float f )      --> Bucket count is multiplied by this when the hash grows
+// float min_load_factor( ), void min_load_factor( float f )  --> Load under which an erase shrinks the hash, 0 never shrinks
+// void bulk_insert( first, last )          --> Inserts every pair in [first, last), reserving room for all of them first
+// HashStats stats( )                       --> Probe length, cluster and rehash statistics (see HashStats.h)
+// void find_batch( keys, n, values )       --> values[i] points at the value of keys[i], or is nullptr (tables only, see StaticHash)
+// void insert_batch( pairs, n )            --> Inserts pairs[0..n) (tables only, see StaticHash)
+// iterator begin( ), end( )                --> Every pair in memory order (tables only, see HashIterator.h)
+// void parallel_for_each( f )              --> f(key, value) for every pair, on all OpenMP threads (tables only, see StaticHash)
 
 
 // void ~Hash( )       --> Destructor
 // Hash( )             --> Basic constructor
 
 //
-//  Hash is an abstract base class for other Hash implementations to inherit from
-//   Expected subclasses include: ChainingHash - uses a vector of lists
-//                                ProbingHash - linear probing on a vector
+//  Hash is the abstract base class for code that picks a table at runtime, e.g.
+//      std::unique_ptr<Hash<int,int>> table(new DynamicHash<ProbingHash<int,int>>());
+//  The tables themselves don't derive from it, they derive from StaticHash (below) and are only
+//  wrapped in a DynamicHash when they have to be used through a Hash pointer, so a call on the table
+//  type itself is an ordinary call the compiler can inline into the caller's loop.
+//   Implementations include: ChainingHash - uses a vector of lists
+//                            ProbingHash - linear probing on a vector
 //  This interface is based upon, and expects similar behavior to the C++11 STL unordered_map
 //
 template <typename K, typename V>
@@ -54,6 +77,8 @@ public:
 
     virtual V& operator[](const K& key) = 0;
 
+    virtual bool lookup(const K& key, V& value) = 0;
+
     virtual int count(const K& key) = 0;
 
     virtual void emplace(K key, V value) = 0;
@@ -74,10 +99,30 @@ public:
 
     virtual void rehash( int n ) = 0;
 
-// *************** Private /internal function implementation ******* //
+    virtual void reserve( int n ) = 0;
 
-private:
-    virtual int hash(const K& key) = 0;
+    virtual float max_load_factor() = 0;
+
+    virtual void max_load_factor(float f) = 0;
+
+    virtual float growth_factor() = 0;
+
+    virtual void growth_factor(float f) = 0;
+
+    virtual float min_load_factor() = 0;
+
+    virtual void min_load_factor(float f) = 0;
+
+    virtual HashStats stats() = 0;
+
+    // Sizes the table once for the whole range instead of growing through every rehash on the way.
+    // Needs a forward iterator over pair<K, V> since the range is measured before inserting.
+    template <typename ForwardIt>
+    void bulk_insert(ForwardIt first, ForwardIt last) {
+        reserve(size() + std::distance(first, last));
+        for (; first != last; ++first)
+            insert(*first);
+    }
 
 };
 
@@ -85,5 +130,206 @@ private:
 template <typename K, typename V>
 Hash<K, V>::~Hash() {}
 
+//
+//  StaticHash is the compile time version of the Hash interface (CRTP): every table derives from
+//  StaticHash<itself, K, V> and has every member listed at the top of this file, none of them
+//  virtual. Code that is templated on the table type, like the benchmark drivers, calls them directly.
+//
+template <typename Derived, typename K, typename V>
+class StaticHash
+{
+public:
+    typedef K key_type;
+    typedef V mapped_type;
+
+    // Same as Hash::bulk_insert, without going through the vtable
+    template <typename ForwardIt>
+    void bulk_insert(ForwardIt first, ForwardIt last) {
+        self().reserve(self().size() + std::distance(first, last));
+        for (; first != last; ++first)
+            self().insert(*first);
+    }
+
+    // Copies the value of key into value, false (and value untouched) if it isn't in the table. Unlike
+    // at() nothing is left pointing into the table, so this is the lookup to use on the concurrent tables
+    // while other threads write: they hide lookup_with_hash with one that copies while the pair can't move.
+    bool lookup(const K& key, V& value) {
+        return self().lookup_with_hash(key, self().hash_function()(key), value);
+    }
+
+    template<typename Q>
+    bool lookup_with_hash(const Q& key, size_t h, V& value) {
+        V* found = self().find_with_hash(key, h);
+        if (!found)
+            return false;
+        value = *found;
+        return true;
+    }
+
+    // Looks up keys[0..n) and sets values[i] to the value of keys[i], or nullptr if it isn't in the table.
+    // Keys are taken BATCH at a time: the whole batch is hashed and every home bucket prefetched before
+    // the first one is probed, so the cache misses of the batch overlap instead of coming one after another.
+    void find_batch(const K* keys, int n, V** values) {
+        typename Derived::hasher hashFunction = self().hash_function();
+        size_t h[BATCH];
+        for (int first = 0; first < n; first += BATCH){
+            int m = std::min(BATCH, n - first);
+            for (int i = 0; i < m; i++){
+                h[i] = hashFunction(keys[first + i]);
+                self().prefetch(h[i]);
+            }
+            for (int i = 0; i < m; i++)
+                values[first + i] = self().find_with_hash(keys[first + i], h[i]);
+        }
+    }
+
+    // Inserts pairs[0..n) the same way, after sizing the table for all of them so no rehash moves
+    // the buckets out from under a batch that has already been prefetched
+    void insert_batch(const std::pair<K, V>* pairs, int n) {
+        self().reserve(self().size() + n);
+        typename Derived::hasher hashFunction = self().hash_function();
+        size_t h[BATCH];
+        for (int first = 0; first < n; first += BATCH){
+            int m = std::min(BATCH, n - first);
+            for (int i = 0; i < m; i++){
+                h[i] = hashFunction(pairs[first + i].first);
+                self().prefetch(h[i]);
+            }
+            for (int i = 0; i < m; i++)
+                self().insert_with_hash(pairs[first + i], h[i]);
+        }
+    }
+
+    // Same, with hashes[i] == hash_function()(pairs[i].first) already worked out by the caller, e.g. in
+    // parallel (see BulkLoader.h). The concurrent tables hide this with a version that inserts in parallel.
+    void insert_batch(const std::pair<K, V>* pairs, const size_t* hashes, int n) {
+        self().reserve(self().size() + n);
+        for (int first = 0; first < n; first += BATCH){
+            int m = std::min(BATCH, n - first);
+            for (int i = 0; i < m; i++)
+                self().prefetch(hashes[first + i]);
+            for (int i = 0; i < m; i++)
+                self().insert_with_hash(pairs[first + i], hashes[first + i]);
+        }
+    }
+
+    // Calls f(const K& key, V& value) for every pair. The buckets are split into chunks that the OpenMP
+    // threads take in turn, so f runs on many threads at once. Nothing may insert or erase until it returns.
+    template <typename F>
+    void parallel_for_each(F f) {
+        self().begin(); //lets the table settle first, ParallelProbingHash finishes a resize in progress
+        int n = self().bucket_count(), chunks = (n + SCAN_CHUNK - 1) / SCAN_CHUNK;
+        #pragma omp parallel for schedule(dynamic)
+        for (int c = 0; c < chunks; c++){
+            int last = c + 1 < chunks ? (c + 1) * SCAN_CHUNK : n; //end() is at bucket n
+            for (auto it = self().iteratorAt(c * SCAN_CHUNK); it.bucket() < last; ++it){
+                auto kv = *it;
+                f(kv.first, kv.second);
+            }
+        }
+    }
+
+    // Pulls the home bucket of a key with hash h into the cache. Tables that can do this hide it with
+    // their own prefetch, the rest still get batches, just without the overlap.
+    void prefetch(size_t h) {}
+
+    // The table's LoadPolicy (see HashPolicy.h). Lowering max_load_factor grows the table straight away
+    // if it is now over the limit, the other two take effect on the next insert or erase.
+    float max_load_factor() {
+        return self().limits.maxLoad;
+    }
+
+    void max_load_factor(float f) {
+        self().limits.setMaxLoad(f);
+        self().reserve(self().size());
+    }
+
+    float growth_factor() {
+        return self().limits.growth;
+    }
+
+    void growth_factor(float f) {
+        self().limits.setGrowth(f);
+    }
+
+    float min_load_factor() {
+        return self().limits.minLoad;
+    }
+
+    void min_load_factor(float f) {
+        self().limits.setMinLoad(f);
+    }
+
+protected:
+    static const int BATCH = 16; //keys in flight at once, enough to cover a miss to memory
+    static const int SCAN_CHUNK = 4096; //buckets handed to a thread at a time by parallel_for_each
+
+    ~StaticHash() {} //not virtual, a table is never deleted through a StaticHash pointer
+
+private:
+    Derived& self() {
+        return static_cast<Derived&>(*this);
+    }
+};
+
+template <typename Derived, typename K, typename V>
+const int StaticHash<Derived, K, V>::BATCH;
+
+template <typename Derived, typename K, typename V>
+const int StaticHash<Derived, K, V>::SCAN_CHUNK;
+
+//
+//  Wraps any table in the Hash interface, for callers that only know at runtime which table they want.
+//  Every call costs one virtual call into the table, the table's own probe loop runs at full speed.
+//
+template <typename Table>
+class DynamicHash : public Hash<typename Table::key_type, typename Table::mapped_type>
+{
+private:
+    typedef typename Table::key_type K;
+    typedef typename Table::mapped_type V;
+
+    Table table;
+
+public:
+    template <typename... Args>
+    DynamicHash(Args&&... args) : table(std::forward<Args>(args)...) {} //arguments go to the table's constructor
+
+    Table& get() { return table; } //the wrapped table, for calls that should skip the vtable
+
+    bool empty() { return table.empty(); }
+    int size() { return table.size(); }
+    V& at(const K& key) { return table.at(key); }
+    V& operator[](const K& key) { return table[key]; }
+    bool lookup(const K& key, V& value) { return table.lookup(key, value); }
+    int count(const K& key) { return table.count(key); }
+    void emplace(K key, V value) { table.emplace(key, value); }
+    void insert(const std::pair<K, V>& pair) { table.insert(pair); }
+    void erase(const K& key) { table.erase(key); }
+    void clear() { table.clear(); }
+    int bucket_count() { return table.bucket_count(); }
+    int bucket_size(int n) { return table.bucket_size(n); }
+    int bucket(const K& key) { return table.bucket(key); }
+    float load_factor() { return table.load_factor(); }
+    void rehash(int n) { table.rehash(n); }
+    void reserve(int n) { table.reserve(n); }
+    float max_load_factor() { return table.max_load_factor(); }
+    void max_load_factor(float f) { table.max_load_factor(f); }
+    float growth_factor() { return table.growth_factor(); }
+    void growth_factor(float f) { table.growth_factor(f); }
+    float min_load_factor() { return table.min_load_factor(); }
+    void min_load_factor(float f) { table.min_load_factor(f); }
+    HashStats stats() { return table.stats(); }
+
+    template <typename ForwardIt>
+    void bulk_insert(ForwardIt first, ForwardIt last) { //the table's own version, which may be parallel
+        table.bulk_insert(first, last);
+    }
+
+    void find_batch(const K* keys, int n, V** values) { table.find_batch(keys, n, values); }
+    void insert_batch(const std::pair<K, V>* pairs, int n) { table.insert_batch(pairs, n); }
+    void insert_batch(const std::pair<K, V>* pairs, const size_t* hashes, int n) { table.insert_batch(pairs, hashes, n); }
+};
+
 
 #endif
@@ -0,0 +1,73 @@
+/*
+ *  Iterators over the pairs of a hash table
+ */
+
+#ifndef __HASH_ITERATOR_H
+#define __HASH_ITERATOR_H
+
+#include <iterator>
+#include <utility>
+#include <cstddef>
+
+//
+// Every table iterator hands out one pair as a std::pair<const K&, V&> that refers into the table.
+// The open addressing tables keep keys and values in separate arrays, so there is no pair<K,V>
+// object to return a reference to. Loops are written
+//     for (auto kv : table)
+//         use(kv.first, kv.second);
+// auto&& works as well, auto& doesn't since *it is a temporary. value_type is a real pair<K,V>, so
+// a range of iterators can be copied into a vector or handed to bulk_insert.
+// Iterators stay valid until the next insert or erase.
+//
+
+// What operator-> returns, it->first works on the temporary pair
+template <typename Ref>
+struct ArrowProxy {
+    Ref ref;
+    Ref* operator->() { return &ref; }
+};
+
+//
+// Forward iterator over the full buckets of an open addressing table, in bucket (= memory) order.
+// Table makes SlotIterator a friend and has
+//   int nextFull( int index )  --> First full bucket at or after index, bucket_count() if there is none
+//   K& slotKey( int index )    --> Key in full bucket index
+//   V& slotValue( int index )  --> Value in full bucket index
+//
+template <typename Table, typename K, typename V>
+class SlotIterator {
+public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef std::pair<K, V> value_type;
+    typedef std::pair<const K&, V&> reference;
+    typedef ArrowProxy<reference> pointer;
+    typedef std::ptrdiff_t difference_type;
+
+    SlotIterator() : table(nullptr), index(0) {}
+    SlotIterator(Table* table, int index) : table(table), index(index) {} //index must be full, or bucket_count() for end
+
+    reference operator*() const { return reference(table->slotKey(index), table->slotValue(index)); }
+    pointer operator->() const { return pointer{**this}; }
+
+    SlotIterator& operator++() {
+        index = table->nextFull(index + 1);
+        return *this;
+    }
+
+    SlotIterator operator++(int) {
+        SlotIterator old = *this;
+        ++*this;
+        return old;
+    }
+
+    bool operator==(const SlotIterator& other) const { return index == other.index; }
+    bool operator!=(const SlotIterator& other) const { return index != other.index; }
+
+    int bucket() const { return index; } //bucket the pair is in
+
+private:
+    Table* table;
+    int index;
+};
+
+#endif //__HASH_ITERATOR_H
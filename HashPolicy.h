@@ -0,0 +1,246 @@
+/*
+ *  Bucket reduction policies shared by the hash tables
+ */
+
+#ifndef __HASH_POLICY_H
+#define __HASH_POLICY_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#if __cplusplus >= 201703L
+#include <string_view>
+#endif
+
+//
+// A reduction policy decides how many buckets a table has and maps a hash value onto one of them.
+// Every policy has the same four members:
+//   int bucketsFor( int n )        --> Smallest bucket count this policy supports that is at least n
+//   void resize( int n )           --> Called with the table's new bucket count (n always came from bucketsFor)
+//   int operator()( size_t h )     --> Bucket index in [0, n) for hash value h
+//   static const bool mixes        --> Whether operator() mixes h itself (see spread)
+//
+// Tables take the policy as a template parameter next to the hash functor, e.g.
+//   ProbingHash<int, int, std::hash<int>, PowerOfTwoMask>
+//
+
+// Mixes all of the bits of h into the low and high bits of the result (wyhash's multiply-xor fold).
+// std::hash is the identity for integers, so any policy that only looks at some of the bits needs this.
+inline uint64_t mix64(uint64_t h) {
+    __uint128_t product = (__uint128_t)(h ^ 0xa0761d6478bd642fULL) * 0xe7037ed1a0b428dbULL;
+    return (uint64_t)(product >> 64) ^ (uint64_t)product;
+}
+
+// Table sizes used by PrimeModulo: 101 and then the next prime after double the previous size,
+// which is exactly the sequence the tables used to find with trial division on every rehash.
+// A few smaller primes come first for tiny tables.
+constexpr int GROWTH_PRIMES[] = {
+    5, 11, 23, 53, 101, 211, 431, 863, 1733, 3467, 6947, 13901, 27803, 55609, 111227, 222461,
+    444929, 889871, 1779761, 3559537, 7119103, 14238221, 28476473, 56952947, 113905901,
+    227811809, 455623621, 911247257, 1822494581
+};
+
+//
+// h % n with a prime n, the original behavior of every table. Uses every bit of the hash, so it
+// works with unmixed hashes. The bucket count comes from GROWTH_PRIMES with a binary search, and
+// the modulo is done with a precomputed reciprocal (Lemire's fastmod) instead of a division.
+//
+struct PrimeModulo {
+    static const bool mixes = false;
+    uint32_t n = 1;
+    uint64_t reciprocal = 0; //2^64 / n rounded up, set by resize
+
+    int bucketsFor(int n) { //smallest growth prime >= n
+        const int* end = GROWTH_PRIMES + sizeof(GROWTH_PRIMES) / sizeof(GROWTH_PRIMES[0]);
+        const int* prime = std::lower_bound(GROWTH_PRIMES, end, n);
+        return prime == end ? end[-1] : *prime;
+    }
+
+    void resize(int n) {
+        this->n = n;
+        reciprocal = UINT64_MAX / n + 1;
+    }
+
+    int operator()(size_t h) const {
+        uint32_t folded = h ^ (h >> 32); //the reciprocal trick is exact for 32 bit values, integer keys below 2^32 are unchanged
+        uint64_t fraction = reciprocal * folded; //low 64 bits of folded / n
+        return ((__uint128_t)fraction * n) >> 64;
+    }
+};
+
+//
+// Power of two bucket count, the hash is mixed and then masked. A multiply and an and per probe.
+//
+struct PowerOfTwoMask {
+    static const bool mixes = true;
+    size_t mask = 0;
+
+    int bucketsFor(int n) {
+        int buckets = 1;
+        while (buckets < n)
+            buckets *= 2;
+        return buckets;
+    }
+
+    void resize(int n) {
+        mask = n - 1;
+    }
+
+    int operator()(size_t h) const {
+        return mix64(h) & mask;
+    }
+};
+
+//
+// Lemire's fastrange: any bucket count, maps the high 32 bits of the mixed hash onto [0, n)
+// with a multiply and a shift instead of a division.
+//
+struct FastRange {
+    static const bool mixes = true;
+    uint64_t n = 1;
+
+    int bucketsFor(int n) {
+        return n;
+    }
+
+    void resize(int n) {
+        this->n = n;
+    }
+
+    int operator()(size_t h) const {
+        return ((mix64(h) >> 32) * n) >> 32;
+    }
+};
+
+// For the open addressing tables: mixes h unless Reduce is going to. Under PrimeModulo std::hash puts
+// sequential integer keys in sequential buckets, which chaining doesn't mind but which makes one
+// cluster of the whole table for linear probing, so every miss and every erase walks all of it.
+template<typename Reduce>
+inline size_t spread(size_t h) {
+    return Reduce::mixes ? h : mix64(h);
+}
+
+//
+// When a table grows and when it shrinks. Every table keeps one, changed through max_load_factor(),
+// growth_factor() and min_load_factor() (see StaticHash):
+//   maxLoad  --> an insert that would take size / buckets over this grows the table first
+//   growth   --> the bucket count is multiplied by this when the table grows
+//   minLoad  --> an erase that leaves size / buckets under this shrinks the table, 0 (the default) never does
+// The table's Reduce policy still rounds every new bucket count up, PrimeModulo and PowerOfTwoMask to
+// about the next doubling, so a growth factor under 2 only shows with FastRange (or SwissHash above 2).
+// A shrink goes to the bucket count that puts the load halfway between minLoad and maxLoad. Keep
+// minLoad well under maxLoad / growth, or a table that has just grown can shrink straight back.
+// The setters throw std::invalid_argument for a value the table can't work with.
+//
+struct LoadPolicy {
+    float maxLoad;
+    float growth = 2;
+    float minLoad = 0;
+    float ceiling; //open addressing needs an empty bucket to end a probe, so maxLoad stays under 1 there
+
+    LoadPolicy(float maxLoad, bool openAddressing)
+        : maxLoad(maxLoad), ceiling(openAddressing ? 1 : std::numeric_limits<float>::infinity()) {}
+
+    void setMaxLoad(float f) {
+        if (!(f > minLoad && f < ceiling))
+            throw std::invalid_argument("max_load_factor must be above min_load_factor" + std::string(ceiling == 1 ? " and below 1" : ""));
+        maxLoad = f;
+    }
+
+    void setGrowth(float f) {
+        if (!(f > 1))
+            throw std::invalid_argument("growth_factor must be above 1");
+        growth = f;
+    }
+
+    void setMinLoad(float f) {
+        if (!(f >= 0 && f < maxLoad))
+            throw std::invalid_argument("min_load_factor must be at least 0 and below max_load_factor");
+        minLoad = f;
+    }
+
+    int bucketsFor(int n) const { //buckets that hold n pairs without going over maxLoad
+        return std::min(n / (double)maxLoad + 1, (double)std::numeric_limits<int>::max());
+    }
+
+    bool overfull(int n, int buckets) const {
+        return n > maxLoad * buckets;
+    }
+
+    bool underfull(int n, int buckets) const {
+        return n < minLoad * buckets;
+    }
+
+    int grown(int buckets, int n) const { //at least growth times the buckets, and room for n pairs
+        return std::max((int)std::min(buckets * (double)growth, (double)std::numeric_limits<int>::max()), bucketsFor(n));
+    }
+
+    int shrunk(int n) const {
+        return n / ((minLoad + maxLoad) / 2) + 1;
+    }
+
+    // For tables that leave tombstones behind: clearing them out at the same size is enough while the
+    // live pairs fill less than two thirds of maxLoad, otherwise the table grows
+    int compactedOrGrown(int buckets, int n) const {
+        return n * 3 > maxLoad * buckets * 2 ? grown(buckets, n) : buckets;
+    }
+};
+
+//
+// Heterogeneous lookup. When a table's HashFn has an is_transparent member type, at(), count(),
+// bucket() and erase() also take any key type Q that HashFn can hash and that compares to K with ==,
+// e.g. a const char* against std::string keys, without building a K first.
+// IfTransparent<HashFn, Q, R>::type is R for such a HashFn, and doesn't exist otherwise.
+//
+template<typename T>
+struct AlwaysVoid {
+    typedef void type;
+};
+
+template<typename HashFn, typename Q, typename R, typename = void>
+struct IfTransparent {};
+
+template<typename HashFn, typename Q, typename R>
+struct IfTransparent<HashFn, Q, R, typename AlwaysVoid<typename HashFn::is_transparent>::type> {
+    typedef R type;
+};
+
+//
+// Transparent string hash: std::string, const char* (and std::string_view from C++17 on) with the
+// same characters hash the same, so a table of std::string keys can be searched with any of them.
+// Eight bytes are folded in per step with mix64.
+//
+struct StringHash {
+    typedef void is_transparent;
+
+    size_t operator()(const std::string& s) const {
+        return bytes(s.data(), s.size());
+    }
+
+    size_t operator()(const char* s) const {
+        return bytes(s, std::strlen(s));
+    }
+
+#if __cplusplus >= 201703L
+    size_t operator()(std::string_view s) const {
+        return bytes(s.data(), s.size());
+    }
+#endif
+
+    static size_t bytes(const char* data, size_t n) {
+        uint64_t h = n, word;
+        for (; n >= 8; data += 8, n -= 8){
+            std::memcpy(&word, data, 8);
+            h = mix64(h ^ word);
+        }
+        word = 0;
+        std::memcpy(&word, data, n); //last 0-7 bytes, zero padded
+        return mix64(h ^ word);
+    }
+};
+
+#endif //__HASH_POLICY_H
@@ -0,0 +1,200 @@
+/*
+ *  Probe length, cluster and rehash statistics for the hash tables
+ */
+
+#ifndef __HASH_STATS_H
+#define __HASH_STATS_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <ostream>
+#include <string>
+
+//
+// Snapshot returned by stats() on every Hash implementation.
+//
+// The structural numbers (cluster and chain histograms, tombstones) are worked out by scanning the
+// table when stats() is called, so they are always available. The per-operation numbers (probe
+// lengths, rehash count and time) are only collected when the program is built with -DHASH_STATS,
+// otherwise the counters aren't even members of the tables and counting is false.
+//
+// A probe is one bucket (or chain entry, or Swiss table group) looked at by a lookup. A lookup is
+// a hit when it found the key. Every at(), operator[], count(), bucket() and erase() is a lookup,
+// count() always walks the key's whole probe sequence.
+//
+struct HashStats {
+    bool counting = false; //true when built with HASH_STATS
+    long hits = 0;
+    long misses = 0;
+    double avgHitProbe = 0;
+    double avgMissProbe = 0;
+    int maxHitProbe = 0;
+    int maxMissProbe = 0;
+    long rehashes = 0;
+    double rehashSeconds = 0; //summed over every thread that helped
+    long tombstones = 0; //DELETED buckets still taking up room
+    std::map<int, long> clusterSizes; //run length of consecutive non-empty buckets, tombstones included --> number of runs (open addressing)
+    std::map<int, long> chainLengths; //chain length --> number of buckets (chaining, empty buckets included)
+
+    // Folds the stats of another table into these, used to report a table made of several smaller ones
+    void merge(const HashStats& other) {
+        counting = counting || other.counting;
+        avgHitProbe = hits + other.hits ? (avgHitProbe * hits + other.avgHitProbe * other.hits) / (hits + other.hits) : 0;
+        avgMissProbe = misses + other.misses ? (avgMissProbe * misses + other.avgMissProbe * other.misses) / (misses + other.misses) : 0;
+        hits += other.hits;
+        misses += other.misses;
+        maxHitProbe = std::max(maxHitProbe, other.maxHitProbe);
+        maxMissProbe = std::max(maxMissProbe, other.maxMissProbe);
+        rehashes += other.rehashes;
+        rehashSeconds += other.rehashSeconds;
+        tombstones += other.tombstones;
+        for (auto& bin : other.clusterSizes)
+            clusterSizes[bin.first] += bin.second;
+        for (auto& bin : other.chainLengths)
+            chainLengths[bin.first] += bin.second;
+    }
+
+    // One JSON object, histograms as {"length": count}
+    void writeJson(std::ostream& out) const {
+        out << "{\"counting\":" << (counting ? "true" : "false")
+            << ",\"hits\":" << hits << ",\"misses\":" << misses
+            << ",\"avg_hit_probe\":" << avgHitProbe << ",\"avg_miss_probe\":" << avgMissProbe
+            << ",\"max_hit_probe\":" << maxHitProbe << ",\"max_miss_probe\":" << maxMissProbe
+            << ",\"rehashes\":" << rehashes << ",\"rehash_seconds\":" << rehashSeconds
+            << ",\"tombstones\":" << tombstones
+            << ",\"cluster_sizes\":";
+        writeJson(out, clusterSizes);
+        out << ",\"chain_lengths\":";
+        writeJson(out, chainLengths);
+        out << "}";
+    }
+
+    // Prometheus text format, every metric is named <name>_<metric>. The per-operation metrics are
+    // left out when they weren't collected, so they don't show up as zeros.
+    void writePrometheus(std::ostream& out, const std::string& name) const {
+        if (counting){
+            out << name << "_lookups_total{result=\"hit\"} " << hits << "\n"
+                << name << "_lookups_total{result=\"miss\"} " << misses << "\n"
+                << name << "_probe_length_avg{result=\"hit\"} " << avgHitProbe << "\n"
+                << name << "_probe_length_avg{result=\"miss\"} " << avgMissProbe << "\n"
+                << name << "_probe_length_max{result=\"hit\"} " << maxHitProbe << "\n"
+                << name << "_probe_length_max{result=\"miss\"} " << maxMissProbe << "\n"
+                << name << "_rehashes_total " << rehashes << "\n"
+                << name << "_rehash_seconds_total " << rehashSeconds << "\n";
+        }
+        out << name << "_tombstones " << tombstones << "\n";
+        for (auto& bin : clusterSizes)
+            out << name << "_clusters{size=\"" << bin.first << "\"} " << bin.second << "\n";
+        for (auto& bin : chainLengths)
+            out << name << "_chains{length=\"" << bin.first << "\"} " << bin.second << "\n";
+    }
+
+private:
+    static void writeJson(std::ostream& out, const std::map<int, long>& histogram) {
+        out << "{";
+        for (auto bin = histogram.begin(); bin != histogram.end(); ++bin)
+            out << (bin == histogram.begin() ? "" : ",") << "\"" << bin->first << "\":" << bin->second;
+        out << "}";
+    }
+};
+
+// Histogram of runs of used buckets in a circular array of n buckets, used(i) tells if bucket i is in use
+template<typename Used>
+void clusterHistogram(int n, Used used, std::map<int, long>& histogram) {
+    int start = 0;
+    while (start < n && used(start)) //start the scan right after an unused bucket so no run is split by the wrap
+        start++;
+    if (start == n){
+        if (n > 0)
+            histogram[n]++;
+        return;
+    }
+    int run = 0;
+    for (int i = 1; i <= n; i++){
+        int index = (start + i) % n;
+        if (used(index))
+            run++;
+        else if (run > 0){
+            histogram[run]++;
+            run = 0;
+        }
+    }
+}
+
+#ifdef HASH_STATS
+
+#define HASH_STATS_ONLY(...) __VA_ARGS__
+
+//
+// Live counters kept by a table built with HASH_STATS. Everything is atomic so the concurrent table
+// can share one set, the cost only exists in instrumented builds.
+//
+class StatsCounters {
+private:
+    std::atomic<long> hits{0}, misses{0}, hitProbes{0}, missProbes{0};
+    std::atomic<int> maxHitProbe{0}, maxMissProbe{0};
+    std::atomic<long> rehashes{0}, rehashNanos{0};
+
+    static void raise(std::atomic<int>& max, int value) {
+        int current = max.load(std::memory_order_relaxed);
+        while (value > current && !max.compare_exchange_weak(current, value, std::memory_order_relaxed)) {}
+    }
+
+public:
+    void lookup(bool hit, int probes) {
+        if (hit){
+            hits.fetch_add(1, std::memory_order_relaxed);
+            hitProbes.fetch_add(probes, std::memory_order_relaxed);
+            raise(maxHitProbe, probes);
+        }
+        else {
+            misses.fetch_add(1, std::memory_order_relaxed);
+            missProbes.fetch_add(probes, std::memory_order_relaxed);
+            raise(maxMissProbe, probes);
+        }
+    }
+
+    void rehashed() {
+        rehashes.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void rehashTime(std::chrono::steady_clock::duration time) {
+        rehashNanos.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(time).count(), std::memory_order_relaxed);
+    }
+
+    void fill(HashStats& stats) const {
+        stats.counting = true;
+        stats.hits = hits;
+        stats.misses = misses;
+        stats.avgHitProbe = hits ? (double)hitProbes / hits : 0;
+        stats.avgMissProbe = misses ? (double)missProbes / misses : 0;
+        stats.maxHitProbe = maxHitProbe;
+        stats.maxMissProbe = maxMissProbe;
+        stats.rehashes = rehashes;
+        stats.rehashSeconds = rehashNanos * 1e-9;
+    }
+};
+
+// Adds the time until the end of the enclosing scope to the counters' rehash time
+class RehashTimer {
+private:
+    StatsCounters& counters;
+    std::chrono::steady_clock::time_point start;
+
+public:
+    RehashTimer(StatsCounters& counters) : counters(counters), start(std::chrono::steady_clock::now()) {}
+
+    ~RehashTimer() {
+        counters.rehashTime(std::chrono::steady_clock::now() - start);
+    }
+};
+
+#else
+
+#define HASH_STATS_ONLY(...)
+
+#endif //HASH_STATS
+
+#endif //__HASH_STATS_H
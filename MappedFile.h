@@ -0,0 +1,160 @@
+/*
+ *  Memory mapped files, for tables that can be saved to disk and opened in place
+ */
+
+#ifndef __MAPPED_FILE_H
+#define __MAPPED_FILE_H
+
+#include <vector>
+#include <memory>
+#include <string>
+#include <stdexcept>
+#include <utility>
+#include <cstddef>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+//
+// A whole file mapped into memory with MAP_PRIVATE: the pages are read in from the file as they are
+// first touched, and a page that is written to gets a private copy, so the file itself never changes.
+// Throws std::runtime_error if the file can't be opened or mapped.
+//
+class MappedFile {
+public:
+    MappedFile(const std::string& path) : base(nullptr), length(0) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd == -1)
+            throw std::runtime_error("Can't open " + path + ": " + std::strerror(errno));
+        struct stat info;
+        if (::fstat(fd, &info) == 0 && info.st_size > 0){
+            length = info.st_size;
+            base = ::mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        }
+        int error = errno;
+        ::close(fd); //the mapping keeps the file alive on its own
+        if (length == 0 || base == MAP_FAILED)
+            throw std::runtime_error("Can't map " + path + ": " + (length == 0 ? "empty file" : std::strerror(error)));
+    }
+
+    ~MappedFile() {
+        ::munmap(base, length);
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    char* data() {
+        return static_cast<char*>(base);
+    }
+
+    size_t size() {
+        return length;
+    }
+
+private:
+    void* base;
+    size_t length;
+};
+
+//
+// Array of T that either owns a std::vector, or refers to memory inside a MappedFile that it keeps
+// alive. Indexing is the same either way. Anything that changes the length (assign, resize, clear)
+// drops the mapping and goes back to an owned vector.
+//
+template<typename T>
+class MappedArray {
+public:
+    MappedArray() : ptr(nullptr), n(0) {}
+
+    MappedArray(const MappedArray& other) : owned(other.ptr, other.ptr + other.n), ptr(owned.data()), n(other.n) {} //a copy always owns its elements
+
+    MappedArray& operator=(MappedArray other) {
+        swap(other);
+        return *this;
+    }
+
+    // Refers to count elements at offset bytes into file, which must be suitably aligned for T
+    void map(std::shared_ptr<MappedFile> file, size_t offset, int count) {
+        std::vector<T>().swap(owned);
+        this->file = file;
+        ptr = reinterpret_cast<T*>(file->data() + offset);
+        n = count;
+    }
+
+    bool mapped() {
+        return file != nullptr;
+    }
+
+    T& operator[](int i) {
+        return ptr[i];
+    }
+
+    T* data() {
+        return ptr;
+    }
+
+    T* begin() {
+        return ptr;
+    }
+
+    T* end() {
+        return ptr + n;
+    }
+
+    int size() {
+        return n;
+    }
+
+    bool empty() {
+        return n == 0;
+    }
+
+    void assign(int count, const T& value) {
+        unmap();
+        owned.assign(count, value);
+        update();
+    }
+
+    void resize(int count) {
+        unmap();
+        owned.resize(count);
+        update();
+    }
+
+    void clear() {
+        unmap();
+        owned.clear();
+        update();
+    }
+
+    void swap(MappedArray& other) {
+        owned.swap(other.owned); //the vectors' buffers don't move, so ptr stays valid on both sides
+        file.swap(other.file);
+        std::swap(ptr, other.ptr);
+        std::swap(n, other.n);
+    }
+
+private:
+    void unmap() {
+        if (file){
+            file.reset();
+            owned.clear();
+        }
+    }
+
+    void update() {
+        ptr = owned.data();
+        n = owned.size();
+    }
+
+    std::vector<T> owned;
+    std::shared_ptr<MappedFile> file;
+    T* ptr;
+    int n;
+};
+
+#endif //__MAPPED_FILE_H
@@ -2,11 +2,19 @@
 #define __PARALLEL_PROBING_HASH_H
 
 #include <vector>
+#include <algorithm>
 #include <stdexcept>
 #include <cmath>
+#include <atomic>
+#include <functional>
+#include <iterator>
+#include <thread>
 #include <omp.h>
 
 #include "Hash.h"
+#include "HashPolicy.h"
+#include "HashStats.h"
+#include "HashIterator.h"
 
 using std::vector;
 using std::pair;
@@ -15,34 +23,148 @@ using std::pair;
 enum Entrystate { //had to change a single letter to lowercase to prevent name collision with probinghash EntryState
     EMPTy = 0,
     VALId = 1,
-    DELETEd = 2
+    DELETEd = 2,
+    BUSy = 3 //slot has been claimed by an insert that hasn't finished writing it yet
 };
 
-template<typename K, typename V>
-class ParallelProbingHash : public Hash<K,V> { // derived from Hash
+//
+// Linear probing hash table that is safe to use from many OpenMP threads at once.
+//  - every slot has an atomic state, inserts claim an EMPTy slot with a compare-and-swap
+//  - inserts and erases hold the lock stripe that their key maps to, so writes on different
+//    stripes never wait on each other
+//  - lookups (lookup, at, count, bucket) never take a lock. Every stripe has a version counter that writers
+//    make odd while they change the table and even again when they are done; a lookup reads the
+//    version, searches, and starts over if the version moved in the meantime (a seqlock)
+//  - lookups are not lock-free though: a lookup waits while a writer holds its key's stripe, and during
+//    a resize it waits for whichever thread is migrating a chunk its key could live in, see read
+//  - growing the table is incremental: the old array is kept next to the new one and split into
+//    chunks, every insert/erase migrates one chunk, and every lookup first makes sure the chunks
+//    its key could live in have been migrated, so all reads and writes only ever touch the new array
+//  - an array that a lookup might still be searching is only freed once every lookup that started
+//    before it was swapped out has finished (see synchronize)
+//  at() and find_with_hash point into the array, which a concurrent insert or erase can resize and free
+//  as soon as they return, so only use them while no other thread writes. lookup copies the value out
+//  before the array can go away and is the one to use alongside writers.
+//  HashFn is the hash functor and Reduce is the policy that maps a hash onto a bucket (see HashPolicy.h),
+//  the hash is mixed first unless Reduce mixes it (see spread)
+//
+template<typename K, typename V, typename HashFn = std::hash<K>, typename Reduce = PrimeModulo>
+class ParallelProbingHash : public StaticHash<ParallelProbingHash<K,V,HashFn,Reduce>, K, V> { // derived from StaticHash
 private:
-    vector<pair<K,Entrystate>> array;
-    int s; //size of table
+    // Buckets are stored as three parallel arrays: one byte of Entrystate per bucket, then the keys,
+    // then the values. Probing only walks the dense state bytes and compares keys, the value array
+    // is only touched once the key has been found. Every array carries the policy that maps keys
+    // onto it, so a lookup can search whichever array it loaded.
+    struct Table {
+        vector<std::atomic<unsigned char>> states; //starts out all EMPTy
+        vector<K> keys;
+        vector<V> values;
+        Reduce reduce;
+
+        Table(int n, Reduce r) : states(n), keys(n), values(n), reduce(r) {
+            if (n > 0)
+                reduce.resize(n);
+        }
+
+        int size() {
+            return states.size();
+        }
+    };
+
+    // Chunk states used while migrating the old array
+    enum ChunkState {
+        PENDING = 0,
+        MIGRATING = 1,
+        MIGRATED = 2
+    };
+
+    static const int CHUNK_SIZE = 1024; //number of old buckets moved by one helping operation
+
+    // A resize in progress, every pair in from is copied into to one chunk at a time
+    struct Migration {
+        Table* from;
+        Table* to;
+        vector<std::atomic<int>> chunks; //ChunkState of each CHUNK_SIZE piece of from
+        std::atomic<int> nextChunk; //next chunk handed out to a helping thread
+        std::atomic<int> chunksDone;
+
+        Migration(Table* from, Table* to)
+            : from(from), to(to), chunks((from->size() + CHUNK_SIZE - 1) / CHUNK_SIZE), nextChunk(0), chunksDone(0) {}
+
+        bool done() {
+            return chunksDone == (int)chunks.size();
+        }
+    };
+
+    // Both are padded out to a cache line, so threads on different stripes don't slow each other down
+    struct StripeVersion {
+        std::atomic<unsigned> version; //odd while a writer is changing the table under this stripe
+        char pad[64 - sizeof(std::atomic<unsigned>)];
+    };
+
+    struct ReaderCount {
+        std::atomic<int> active[2]; //lookups in flight, split by the parity of the epoch they started in
+        char pad[64 - 2 * sizeof(std::atomic<int>)];
+    };
+
+    std::atomic<Table*> array;
+    std::atomic<Migration*> migration; //nullptr unless a resize is in progress
+    std::atomic<int> s; //size of table
+    std::atomic<int> tombstones; //DELETEd slots in array, they still take up room until the next resize
+    std::atomic<int> buckets; //size of array
+    vector<omp_lock_t> stripes; //number of stripes is always a power of 2
+    vector<StripeVersion> versions; //one per stripe
+    vector<ReaderCount> readers; //one per reading thread, as many as there are stripes
+    std::atomic<int> epoch; //moved on every time an array or migration is about to be freed
+
+    HashFn hashFunction;
+    Reduce reduce; //only used to pick sizes, every Table has its own sized copy
+    LoadPolicy limits; //see HashPolicy.h
+    HASH_STATS_ONLY(StatsCounters counters;)
+
+    friend class StaticHash<ParallelProbingHash, K, V>;
+    friend class SlotIterator<ParallelProbingHash, K, V>;
 
 public:
-    ParallelProbingHash(int n = 101) {
-        array.resize(n);
-        makeEmpty(); //initialize all spots to empty
+    typedef HashFn hasher;
+    typedef SlotIterator<ParallelProbingHash, K, V> iterator; //see HashIterator.h
+
+    ParallelProbingHash(int n = 101) : migration(nullptr), s(0), tombstones(0), epoch(0), limits(0.75, true) {
+        n = reduce.bucketsFor(n);
+        array = new Table(n, reduce);
+        buckets = n;
+        int numStripes = 64;
+        while (numStripes < 16 * omp_get_max_threads()) //keep the chance of two threads sharing a stripe low
+            numStripes *= 2;
+        stripes.resize(numStripes);
+        for (auto& lock : stripes)
+            omp_init_lock(&lock);
+        vector<StripeVersion>(numStripes).swap(versions); //value initialized, so every counter starts at 0
+        vector<ReaderCount>(numStripes).swap(readers);
     }
 
     void makeEmpty(){
-        for (auto& item: array){
-            item.second = EMPTy;
+        lockAll();
+        beginWriteAll();
+        dropMigration();
+        for (auto& state: array.load()->states){
+            state.store(EMPTy, std::memory_order_relaxed);
         }
         s = 0;
+        tombstones = 0;
+        endWriteAll();
+        unlockAll();
     }
 
     ~ParallelProbingHash() {
         this->clear();
+        delete array.load();
+        for (auto& lock : stripes)
+            omp_destroy_lock(&lock);
     }
 
     bool empty() {
-        return array.empty();
+        return buckets == 0;
     }
 
     int size() {
@@ -50,39 +172,25 @@ public:
     }
 
     V& at(const K& key) {
-        int index = hash(key), i=0;
-        while (array[index + i].second != EMPTy){ //while we haven't seen an empty bucket
-            if (array[index + i].first == key)
-                return array[index + i].second; //if keys match return the corresponding value
-            i++;
-            if (i == bucket_count()) 
-                i = -1 * index; //moves the index to the beginning of the array so it doesn't go beyond the array's bounds
-        }
-        cout << "Key not in hash" << endl;
+        return valueOf(find_with_hash(key, hashFunction(key)));
+    }
+
+    template<typename Q>
+    typename IfTransparent<HashFn, Q, V&>::type at(const Q& key) {
+        return valueOf(find_with_hash(key, hashFunction(key)));
     }
 
     V& operator[](const K& key) {
-        int index = hash(key), i=0;
-        while (array[index + i].second != EMPTy){ //while we haven't seen an empty bucket
-            if (array[index + i].first == key)
-                return array[index + i].second; //if keys match return the corresponding value
-            i++;
-            if (i == bucket_count()) //
-                i = -1 * index; //moves the index to the beginning of the array so it doesn't go beyond the array's bounds
-        }
-        cout << "Key not in hash" << endl;
+        return at(key);
     }
 
     int count(const K& key) {
-        int index = hash(key), i=0, total=0;
-        while (array[index + i].second != EMPTy){ //while we haven't seen an empty bucket
-            if (array[index + i].first == key) //if we find a key matching the given value increment the total
-                total++;
-            i++;
-            if (i == bucket_count()) 
-                i = -1 * index; //moves the index to the beginning of the array so it doesn't go beyond the array's bounds
-        }
-        return total;
+        return count_with_hash(key, hashFunction(key));
+    }
+
+    template<typename Q>
+    typename IfTransparent<HashFn, Q, int>::type count(const Q& key) {
+        return count_with_hash(key, hashFunction(key));
     }
 
     void emplace(K key, V value) {
@@ -90,131 +198,568 @@ public:
     }
 
     void insert(const std::pair<K, V>& pair) {
-        int index = hash(pair.first), i=0;
-        while (array[index + i].second != EMPTy){ //while there isn't an empty bucket, increment by 1 (linear probing)
-            i++;
-            if (i == bucket_count()) 
-                i = -1 * index; //moves the index to the beginning of the array so it doesn't go beyond the array's bounds
-        }
-        array[index + i] = {pair.first, VALId}; //insert the pair in the empty bucket
-        s++;
-        // if (load_factor() > 0.75) //rehash if above load factor
-        //     rehash();
+        insert_with_hash(pair, hashFunction(pair.first));
     }
 
-    void checkRehash(){ //checks load factor and rehashes if above 0.75
-        if (load_factor() > 0.75)
-            rehash();
+    void checkRehash(){ //finishes a resize once every chunk has moved, starts one if load factor is out of bounds or there are too many tombstones
+        int e = enterRead(); //keeps the migration from being freed while we look at it
+        Migration* m = migration;
+        bool done = m && m->done();
+        exitRead(e);
+        if (done)
+            finishMigration();
+        if (needsResize())
+            startMigration(resizeTarget(), true);
     }
 
     void erase(const K& key) {
-        int index = hash(key), i=0;
-        while (array[index + i].first != key){ //while the current index isn't the pair we're looking for, increment by 1 (linear probing)
-            if (array[index + i].second == EMPTy){ //if we reach an empty spot, the key doesn't exist, return
-                cout << "Key not in hash" << endl;
-                return;
-            }
-            i++;
-            if (i == bucket_count())
-                i = -1 * index; //moves the index to the beginning of the array so it doesn't go beyond the array's bounds
-        }
-        array[index + i].second == DELETEd; //mark the targeted pair as deleted (lazy deletion)
-        s--;
+        erase_with_hash(key, hashFunction(key));
+    }
+
+    template<typename Q>
+    typename IfTransparent<HashFn, Q, void>::type erase(const Q& key) {
+        erase_with_hash(key, hashFunction(key));
     }
 
     void clear() {
-        array.clear();
+        Table* empty = new Table(0, reduce);
+        lockAll();
+        beginWriteAll();
+        dropMigration();
+        Table* old = array.exchange(empty);
+        buckets = 0;
         s = 0;
+        tombstones = 0;
+        synchronize(); //lookups may still be searching the old array
+        endWriteAll();
+        unlockAll();
+        delete old;
     }
 
     int bucket_count() {
-        return array.capacity();
+        return buckets;
     }
 
     int bucket_size(int n) {
-        return array[n].second == VALId ? 1 : 0;
+        int e = enterRead();
+        int state = array.load(std::memory_order_acquire)->states[n].load(std::memory_order_acquire);
+        exitRead(e);
+        return state == VALId ? 1 : 0;
     }
 
     int bucket(const K& key) {
-        int index = hash(key), i=0;
-        while (array[index + i].second != EMPTy){ //while we haven't seen an empty bucket
-            if (array[index + i].first == key)
-                return index + i; //if the keys match, return the position
-            i++;
-            if (i == bucket_count())
-                i = -1 * index; //moves the index to the beginning of the array so it doesn't go beyond the array's bounds
-        }
-        cout << "Key not in hash" << endl;
-        return -1; //return invalid position if pair can't be found
+        return bucket_with_hash(key, hashFunction(key));
+    }
+
+    template<typename Q>
+    typename IfTransparent<HashFn, Q, int>::type bucket(const Q& key) {
+        return bucket_with_hash(key, hashFunction(key));
     }
 
     float load_factor() {
-        return ((float)s/(float)array.capacity());
+        return ((float)s/(float)buckets);
     }
 
     void rehash() {
-        vector<pair<K,Entrystate>> oldArray = array;
-
-        array.resize(findNextPrime(2 * array.capacity())); //double current size and find prime
-
-        makeEmpty(); //make all states empty //size is reset in function as well
-
-        for (auto& item: oldArray){ //iterate through entire old array
-            if (item.second == VALId){ //if item is valid
-                //insert(std::move(item)); //move into newly resized array
-                int index = hash(item.first), i=0;
-                while (array[index + i].second != EMPTy){ //while there isn't an empty bucket, increment by 1 (linear probing)
-                    i++;
-                    if (i == bucket_count()) 
-                        i = -1 * index; //moves the index to the beginning of the array so it doesn't go beyond the array's bounds
-                }
-                array[index + i] = std::move(item); //insert the pair in the empty bucket
-                s++;
-            }
-        }
+        startMigration(reduce.bucketsFor(limits.grown(bucket_count(), s + 1)), false); //grow by the growth factor
+        lockAll();
+        drainMigration(); //caller expects the table to be fully resized when this returns
+        unlockAll();
     }
 
     void rehash(int n) {
-        vector<pair<K,Entrystate>> oldArray = array;
+        startMigration(reduce.bucketsFor(std::max(n, limits.bucketsFor(size()))), false); //never fewer buckets than the pairs need, rounded up to a size the policy supports
+        lockAll();
+        drainMigration();
+        unlockAll();
+    }
+
+    void reserve(int n) {
+        int needed = limits.bucketsFor(n); //buckets needed to hold n elements without going over the max load factor
+        if (needed > bucket_count())
+            rehash(needed);
+    }
+
+    HashStats stats() {
+        HashStats stats;
+        HASH_STATS_ONLY(counters.fill(stats));
+        lockAll();
+        Table& t = *array.load();
+        clusterHistogram(t.size(), [&t](int i) { return t.states[i].load(std::memory_order_relaxed) != EMPTy; }, stats.clusterSizes);
+        stats.tombstones = tombstones;
+        unlockAll();
+        return stats;
+    }
 
-        array.resize(findNextPrime(n)); //find next prime after given value
+    // Iterators walk the array in memory order, skipping EMPTy and DELETEd buckets. begin() first
+    // finishes any resize in progress so that every pair is in the one array. Iterating is not safe
+    // while other threads insert or erase.
+    iterator begin() {
+        lockAll();
+        drainMigration();
+        unlockAll();
+        return iteratorAt(0);
+    }
+
+    iterator end() {
+        return iterator(this, array.load()->size());
+    }
+
+    HashFn hash_function() {
+        return hashFunction;
+    }
+
+    // Lookups and inserts with a hash the caller already has, h must be hash_function()(key). Callers that
+    // hash a key once for several tables, or keep the hash next to the key, skip hashing it again.
+    // find_with_hash returns the key's value, or nullptr (see the top of the file for when that is safe).
+    template<typename Q>
+    V* find_with_hash(const Q& key, size_t h) {
+        h = spread<Reduce>(h); //the stripe and the bucket both come from the mixed hash, see spread in HashPolicy.h
+        int probes = 0;
+        V* value = read<V*>(h, [&](Table& t) -> V* {
+            int index = find(t, key, h, probes);
+            return index == -1 ? nullptr : &t.values[index];
+        });
+        HASH_STATS_ONLY(counters.lookup(value != nullptr, probes));
+        return value;
+    }
+
+    // Hides StaticHash's version with one that copies the value while we are still counted as a reader,
+    // a VALId bucket's value is never written again so the copy can't tear
+    template<typename Q>
+    bool lookup_with_hash(const Q& key, size_t h, V& value) {
+        h = spread<Reduce>(h);
+        int probes = 0;
+        bool found = read<bool>(h, [&](Table& t) {
+            int index = find(t, key, h, probes);
+            if (index == -1)
+                return false;
+            value = t.values[index];
+            return true;
+        });
+        HASH_STATS_ONLY(counters.lookup(found, probes));
+        return found;
+    }
 
-        makeEmpty(); //make all states empty //size is reset in function as well
+    void insert_with_hash(const std::pair<K, V>& pair, size_t h) {
+        h = spread<Reduce>(h);
+        if (buckets == 0) //a cleared table has nothing to probe
+            checkRehash();
+        int stripe = lockStripe(h);
+        Table& t = *array.load(std::memory_order_relaxed); //can't be swapped out while we hold a stripe
+        helpMigrate(); //new pairs always go in the new array, old ones can move over at any pace
+        beginWrite(stripe);
+        int n = t.size(), index = t.reduce(h);
+        while (!claim(t.states[index])) //linear probing until we win an empty bucket
+            index = next(index, n);
+        t.keys[index] = pair.first;
+        t.values[index] = pair.second;
+        t.states[index].store(VALId, std::memory_order_release); //publish the pair to readers
+        s++;
+        endWrite(stripe);
+        omp_unset_lock(&stripes[stripe]);
+        checkRehash();
+    }
+
+    template<typename Q>
+    int count_with_hash(const Q& key, size_t h) {
+        h = spread<Reduce>(h);
+        int probes = 0;
+        int total = read<int>(h, [&](Table& t) {
+            int n = t.size(), index = n > 0 ? t.reduce(h) : 0, i = 0, total = 0, state;
+            while (i < n && (state = t.states[index].load(std::memory_order_acquire)) != EMPTy){ //while we haven't seen an empty bucket
+                if (state == VALId && t.keys[index] == key) //if we find a key matching the given value increment the total
+                    total++;
+                index = next(index, n);
+                i++;
+            }
+            probes = i;
+            return total;
+        });
+        HASH_STATS_ONLY(counters.lookup(total > 0, probes));
+        return total;
+    }
+
+    template<typename Q>
+    int bucket_with_hash(const Q& key, size_t h) {
+        h = spread<Reduce>(h);
+        int probes = 0;
+        int index = read<int>(h, [&](Table& t) { return find(t, key, h, probes); });
+        HASH_STATS_ONLY(counters.lookup(index != -1, probes));
+        if (index == -1)
+            throw std::out_of_range("Key not in hash");
+        return index;
+    }
 
-        for (auto& item: oldArray){ //iterate through entire old array
-            if (item.second == VALId) //if item is valid
-                insert(std::move(item)); //move into newly resized array
+    template<typename Q>
+    void erase_with_hash(const Q& key, size_t h) {
+        h = spread<Reduce>(h);
+        int stripe = lockStripe(h);
+        Table& t = *array.load(std::memory_order_relaxed);
+        ensureMigrated(t, h);
+        helpMigrate();
+        beginWrite(stripe);
+        int n = t.size(), index = t.reduce(h), i = 0;
+        unsigned char state;
+        while (i < n && (state = t.states[index].load(std::memory_order_acquire)) != EMPTy){ //linear probing until we reach an empty bucket
+            if (state == VALId && t.keys[index] == key
+                && t.states[index].compare_exchange_strong(state, DELETEd)){ //mark the targeted pair as deleted (lazy deletion)
+                HASH_STATS_ONLY(counters.lookup(true, i + 1));
+                s--;
+                tombstones++;
+                endWrite(stripe);
+                omp_unset_lock(&stripes[stripe]);
+                checkRehash(); //a delete heavy workload compacts the table once tombstones pile up
+                return;
+            }
+            index = next(index, n);
+            i++;
         }
+        endWrite(stripe);
+        omp_unset_lock(&stripes[stripe]);
+        HASH_STATS_ONLY(counters.lookup(false, i)); //nothing to erase, like unordered_map::erase
+    }
+
+    void prefetch(size_t h) { //see StaticHash::find_batch, the array can't be freed while we are counted as a reader
+        h = spread<Reduce>(h);
+        int e = enterRead();
+        Table& t = *array.load(std::memory_order_acquire);
+        if (t.size() > 0){
+            int index = t.reduce(h);
+            __builtin_prefetch(&t.states[index]);
+            __builtin_prefetch(&t.keys[index]);
+        }
+        exitRead(e);
+    }
+
+
+    // Sizes the table once, then splits the range evenly across the OpenMP threads. Hides
+    // StaticHash::bulk_insert, which inserts one pair at a time.
+    template <typename ForwardIt>
+    void bulk_insert(ForwardIt first, ForwardIt last) {
+        bulkInsert(first, last, typename std::iterator_traits<ForwardIt>::iterator_category());
+    }
+
+    using StaticHash<ParallelProbingHash, K, V>::insert_batch;
+
+    // Hides StaticHash's version with one that splits the pairs across the OpenMP threads
+    void insert_batch(const std::pair<K, V>* pairs, const size_t* hashes, int n) {
+        reserve(size() + n);
+        #pragma omp parallel for schedule(static)
+        for (int i = 0; i < n; i++)
+            insert_with_hash(pairs[i], hashes[i]);
     }
 
 private:
-    int findNextPrime(int n)
-    {
-        while (!isPrime(n))
-        {
-            n++;
+    template <typename RandomIt>
+    void bulkInsert(RandomIt first, RandomIt last, std::random_access_iterator_tag) {
+        int n = last - first;
+        reserve(size() + n);
+        #pragma omp parallel for schedule(static)
+        for (int i = 0; i < n; i++)
+            insert(first[i]);
+    }
+
+    template <typename ForwardIt>
+    void bulkInsert(ForwardIt first, ForwardIt last, std::forward_iterator_tag) { //can't be split up front, so copy it into a vector first
+        vector<pair<K,V>> pairs(first, last);
+        bulkInsert(pairs.begin(), pairs.end(), std::random_access_iterator_tag());
+    }
+
+    V& valueOf(V* value) {
+        if (!value)
+            throw std::out_of_range("Key not in hash");
+        return *value; //if keys match return the corresponding value
+    }
+
+    //
+    // Runs lookup on the current array without taking a lock and returns what it returned. Starts
+    // over whenever a writer changed the key's stripe while lookup ran, so the result is one the table
+    // really had at some point. lookup must not write to the table, and may run more than once, so
+    // it leaves counting to the caller. Blocking: waits out a writer that holds the stripe, and
+    // ensureMigrated may wait for another thread's chunk.
+    //
+    template <typename R, typename Lookup>
+    R read(size_t h, Lookup lookup) { //h is the key's spread hash
+        StripeVersion& stripe = versions[h & (stripes.size() - 1)];
+        for (;;){
+            unsigned before = stripe.version.load(std::memory_order_acquire);
+            if (before & 1){ //a writer is in the middle of changing this stripe
+                std::this_thread::yield();
+                continue;
+            }
+            int e = enterRead();
+            Table& t = *array.load(std::memory_order_acquire);
+            ensureMigrated(t, h);
+            R result = lookup(t);
+            std::atomic_thread_fence(std::memory_order_acquire); //keeps the searches above from moving past the version check
+            bool unchanged = stripe.version.load(std::memory_order_relaxed) == before;
+            exitRead(e);
+            if (unchanged)
+                return result;
         }
-        return n;
     }
 
-    int isPrime(int n)
-    {
-        for (int i = 2; i <= sqrt(n); i++)
-        {
-            if (n % i == 0)
-            {
-                return false;
+    // Every lookup is counted in its thread's ReaderCount for the epoch it started in, so that
+    // synchronize can wait for the ones that might still be using an array it is about to free
+    int enterRead() {
+        ReaderCount& mine = readers[readerSlot() & (readers.size() - 1)];
+        for (;;){
+            int e = epoch.load();
+            mine.active[e & 1]++;
+            if (epoch.load() == e) //still the same epoch, so synchronize is sure to see us
+                return e;
+            mine.active[e & 1]--;
+        }
+    }
+
+    void exitRead(int e) {
+        readers[readerSlot() & (readers.size() - 1)].active[e & 1].fetch_sub(1, std::memory_order_release);
+    }
+
+    // Waits for every lookup that started before this call. Lookups that start after it see whatever
+    // the caller unpublished beforehand. Caller must hold every stripe, so two calls never overlap.
+    void synchronize() {
+        int e = epoch.load();
+        epoch.store(e + 1);
+        for (auto& count : readers){
+            while (count.active[e & 1].load(std::memory_order_acquire) != 0)
+                std::this_thread::yield();
+        }
+    }
+
+    static int readerSlot() { //threads get a ReaderCount each, until there are more threads than counts
+        static std::atomic<int> nextSlot(0);
+        static thread_local int slot = nextSlot++;
+        return slot;
+    }
+
+    void beginWrite(int stripe) { //caller must hold the stripe
+        versions[stripe].version.fetch_add(1, std::memory_order_acq_rel);
+    }
+
+    void endWrite(int stripe) {
+        versions[stripe].version.fetch_add(1, std::memory_order_release);
+    }
+
+    void beginWriteAll() { //caller must hold every stripe
+        for (int i = 0; i < (int)versions.size(); i++)
+            beginWrite(i);
+    }
+
+    void endWriteAll() {
+        for (int i = 0; i < (int)versions.size(); i++)
+            endWrite(i);
+    }
+
+    // Swaps in a new array of n buckets and starts migrating the current one into it. Only the
+    // pointer swap happens with every stripe held, the new array is allocated before taking them.
+    void startMigration(int n, bool onlyIfNeeded) {
+        HASH_STATS_ONLY(auto allocating = std::chrono::steady_clock::now());
+        Table* bigger = new Table(n, reduce);
+        HASH_STATS_ONLY(counters.rehashTime(std::chrono::steady_clock::now() - allocating));
+        lockAll();
+        drainMigration(); //a resize can't start until the previous one is finished
+        if (!limits.overfull(s, n) && (!onlyIfNeeded || needsResize())){ //another thread may have resized the table or filled it up while we waited
+            migration = new Migration(array, bigger); //published before the array, so a lookup that loads the new array also sees the migration
+            array = bigger;
+            buckets = n;
+            tombstones = 0; //tombstones are left behind in the old array
+            bigger = nullptr;
+            HASH_STATS_ONLY(counters.rehashed());
+        }
+        unlockAll();
+        delete bigger; //still ours if the resize turned out not to be needed
+    }
+
+    // Tombstones count against the load because inserts can't reuse them, and once they make up a
+    // quarter of the table they are cleared out even if the load is fine, since every miss has to walk them
+    bool needsResize() {
+        return buckets == 0 || limits.overfull(s + tombstones, buckets) || tombstones > buckets / 4
+            || (limits.underfull(s, buckets) && shrunkSize() < buckets);
+    }
+
+    // Migrating into a same size array is enough to compact the table when most of the used buckets
+    // are tombstones, otherwise the table grows, or shrinks once it is under the min load factor
+    int resizeTarget() {
+        if (limits.underfull(s, buckets) && shrunkSize() < buckets)
+            return shrunkSize();
+        return reduce.bucketsFor(limits.compactedOrGrown(bucket_count(), s + 1));
+    }
+
+    int shrunkSize() { //only a shrink if the policy rounds it to fewer buckets than there are now
+        return reduce.bucketsFor(limits.shrunk(s));
+    }
+
+    // Frees the old array once every chunk has been moved out of it
+    void finishMigration() {
+        lockAll();
+        Migration* m = migration;
+        if (m && m->done())
+            retire(m);
+        unlockAll();
+    }
+
+    // Moves whatever is left of the old array, caller must hold every stripe
+    void drainMigration() {
+        Migration* m = migration;
+        if (!m)
+            return;
+        for (int c = 0; c < (int)m->chunks.size(); c++)
+            migrateChunk(*m, c);
+        for (auto& chunk : m->chunks){
+            while (chunk.load(std::memory_order_acquire) != MIGRATED) //a lookup may still be moving this one
+                std::this_thread::yield();
+        }
+        retire(m);
+    }
+
+    void dropMigration() { //caller must hold every stripe and is about to throw away what's in the array anyway
+        Migration* m = migration;
+        if (m)
+            retire(m);
+    }
+
+    // Unpublishes a migration, then frees it and its old array once no lookup can still be using
+    // them. Caller must hold every stripe and make sure no chunk is still MIGRATING.
+    void retire(Migration* m) {
+        migration = nullptr;
+        synchronize();
+        delete m->from;
+        delete m;
+    }
+
+    // Migrates the next unclaimed chunk, called by every insert and erase while a resize is running.
+    // Caller must hold a stripe.
+    void helpMigrate() {
+        Migration* m = migration;
+        if (!m)
+            return;
+        int c;
+        while ((c = m->nextChunk++) < (int)m->chunks.size()){
+            if (migrateChunk(*m, c)) //a lookup may have already claimed this chunk, if so try the next one
+                return;
+        }
+    }
+
+    // Makes sure every old chunk the key's probe sequence passes through has been moved into t, so
+    // that lookups only have to search t. Nothing to do unless t is the array being migrated into,
+    // a lookup that loaded an array just before it was swapped out can search it as it is.
+    void ensureMigrated(Table& t, size_t h) { //h is the key's spread hash
+        Migration* m = migration.load(std::memory_order_acquire);
+        if (!m || m->to != &t)
+            return;
+        Table& from = *m->from;
+        int n = from.size(), index = n > 0 ? from.reduce(h) : 0;
+        for (int i = 0; i < n; ){
+            int c = index / CHUNK_SIZE;
+            migrateChunk(*m, c);
+            while (m->chunks[c].load(std::memory_order_acquire) != MIGRATED) //another thread is moving this chunk right now
+                std::this_thread::yield();
+            int end = std::min(n, (c + 1) * CHUNK_SIZE);
+            for (; index < end && i < n; index++, i++){ //the old array's states never change during a migration
+                if (from.states[index].load(std::memory_order_relaxed) == EMPTy)
+                    return; //end of the probe sequence
             }
+            if (index == n)
+                index = 0; //wrap around to the beginning of the array
         }
+    }
 
+    // Copies every valid pair in chunk c of the old array into the new array, returns false if
+    // another thread already claimed the chunk. The pairs are copied rather than moved, since
+    // lookups that loaded the old array before the swap may still be reading them.
+    bool migrateChunk(Migration& m, int c) {
+        int expected = PENDING;
+        if (m.chunks[c].load(std::memory_order_relaxed) != PENDING
+            || !m.chunks[c].compare_exchange_strong(expected, MIGRATING, std::memory_order_acquire))
+            return false;
+        HASH_STATS_ONLY(RehashTimer timer(counters));
+        Table& from = *m.from;
+        Table& to = *m.to;
+        int n = to.size(), end = std::min(from.size(), (c + 1) * CHUNK_SIZE);
+        for (int i = c * CHUNK_SIZE; i < end; i++){
+            if (from.states[i].load(std::memory_order_relaxed) == VALId){ //if item is valid
+                int index = home(to, from.keys[i]);
+                while (!claim(to.states[index])) //inserts from other threads may be racing us for buckets
+                    index = next(index, n);
+                to.keys[index] = from.keys[i];
+                to.values[index] = from.values[i];
+                to.states[index].store(VALId, std::memory_order_release);
+            }
+        }
+        m.chunks[c].store(MIGRATED, std::memory_order_release);
+        m.chunksDone++;
         return true;
     }
 
-    int hash(const K& key) {
-        std::hash<K> hashFunction;
-        return hashFunction(key) % this->bucket_count();       
+    // Returns the position of the first valid slot holding key in t, or -1
+    template<typename Q>
+    int find(Table& t, const Q& key, size_t h, int& probes) { //probes gets the buckets looked at, callers count the lookup once read returns
+        int n = t.size(), index = n > 0 ? t.reduce(h) : 0, i = 0, state;
+        while (i < n && (state = t.states[index].load(std::memory_order_acquire)) != EMPTy){ //while we haven't seen an empty bucket
+            if (state == VALId && t.keys[index] == key){
+                probes = i + 1;
+                return index;
+            }
+            index = next(index, n);
+            i++;
+        }
+        probes = i;
+        return -1;
+    }
+
+    // Tries to take ownership of an empty slot, only one thread can win a given slot
+    bool claim(std::atomic<unsigned char>& state) {
+        unsigned char expected = EMPTy;
+        return state.load(std::memory_order_relaxed) == EMPTy
+            && state.compare_exchange_strong(expected, BUSy, std::memory_order_acquire);
+    }
+
+    int next(int index, int n) {
+        return index + 1 == n ? 0 : index + 1; //wrap around to the beginning of the array
     }
-    
+
+    int lockStripe(size_t h) { //h is the key's spread hash
+        int stripe = h & (stripes.size() - 1); //stripe doesn't depend on the table size, so it survives a rehash
+        omp_set_lock(&stripes[stripe]);
+        return stripe;
+    }
+
+    void lockAll() {
+        for (auto& lock : stripes) //always taken in the same order so two resizing threads can't deadlock
+            omp_set_lock(&lock);
+    }
+
+    void unlockAll() {
+        for (auto& lock : stripes)
+            omp_unset_lock(&lock);
+    }
+
+    iterator iteratorAt(int b) { //first pair in bucket b or after it
+        return iterator(this, nextFull(b));
+    }
+
+    int nextFull(int index) {
+        Table& t = *array.load(std::memory_order_relaxed);
+        int n = t.size();
+        while (index < n && t.states[index].load(std::memory_order_relaxed) != VALId)
+            index++;
+        return index;
+    }
+
+    K& slotKey(int index) {
+        return array.load(std::memory_order_relaxed)->keys[index];
+    }
+
+    V& slotValue(int index) {
+        return array.load(std::memory_order_relaxed)->values[index];
+    }
+
+    int home(Table& t, const K& key) { //bucket of key in t
+        return t.reduce(spread<Reduce>(hashFunction(key)));
+    }
+
 };
 
 #endif //__PARALLEL_PROBING_HASH_H
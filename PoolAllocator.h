@@ -0,0 +1,149 @@
+/*
+ *  Slab allocator for hash table nodes
+ */
+
+#ifndef __POOL_ALLOCATOR_H
+#define __POOL_ALLOCATOR_H
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <vector>
+
+//
+// Hands out small objects from large contiguous blocks. Freed objects go on a free list for their
+// size and are reused by the next allocation of that size, the blocks themselves are only given
+// back to the system by release() (or when the pool is destroyed).
+//
+class NodePool {
+private:
+    static const size_t BLOCK_SIZE = 64 * 1024; //bytes per block
+    static const size_t ALIGN = alignof(std::max_align_t);
+    static const size_t MAX_NODE = 256; //anything bigger skips the pool
+
+    struct FreeNode {
+        FreeNode* next;
+    };
+
+    std::vector<char*> blocks;
+    char* next; //bump pointer into the newest block
+    char* end;
+    FreeNode* freeLists[MAX_NODE / ALIGN]; //one list per size class
+
+public:
+    NodePool() : next(nullptr), end(nullptr) {
+        for (auto& list : freeLists)
+            list = nullptr;
+    }
+
+    NodePool(const NodePool&) = delete;
+    NodePool& operator=(const NodePool&) = delete;
+
+    ~NodePool() {
+        release();
+    }
+
+    void* allocate(size_t bytes) {
+        bytes = roundUp(bytes);
+        if (bytes > MAX_NODE)
+            return ::operator new(bytes);
+        FreeNode*& list = freeLists[bytes / ALIGN - 1];
+        if (list){ //reuse a freed node first
+            FreeNode* node = list;
+            list = node->next;
+            return node;
+        }
+        if (next + bytes > end){ //start a new block, whatever is left of the old one is skipped
+            next = static_cast<char*>(::operator new(BLOCK_SIZE));
+            end = next + BLOCK_SIZE;
+            blocks.push_back(next);
+        }
+        void* node = next;
+        next += bytes;
+        return node;
+    }
+
+    void deallocate(void* p, size_t bytes) {
+        bytes = roundUp(bytes);
+        if (bytes > MAX_NODE){
+            ::operator delete(p);
+            return;
+        }
+        FreeNode* node = static_cast<FreeNode*>(p);
+        node->next = freeLists[bytes / ALIGN - 1];
+        freeLists[bytes / ALIGN - 1] = node;
+    }
+
+    // Frees every block at once, every node handed out by this pool must already be gone
+    void release() {
+        for (char* block : blocks)
+            ::operator delete(block);
+        blocks.clear();
+        next = end = nullptr;
+        for (auto& list : freeLists)
+            list = nullptr;
+    }
+
+private:
+    static size_t roundUp(size_t bytes) {
+        return bytes < ALIGN ? ALIGN : (bytes + ALIGN - 1) / ALIGN * ALIGN;
+    }
+};
+
+//
+// STL allocator on top of a shared NodePool. Copies (including rebound copies, e.g. the list node
+// allocator a std::list makes from PoolAllocator<pair<K,V>>) share the same pool, so nodes can be
+// spliced between containers that were built from the same allocator.
+// Single objects come from the pool, arrays go straight to operator new.
+//
+template <typename T>
+class PoolAllocator {
+public:
+    typedef T value_type;
+
+    std::shared_ptr<NodePool> pool;
+
+    PoolAllocator() : pool(std::make_shared<NodePool>()) {}
+
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U>& other) : pool(other.pool) {}
+
+    T* allocate(size_t n) {
+        if (n == 1)
+            return static_cast<T*>(pool->allocate(sizeof(T)));
+        return static_cast<T*>(::operator new(n * sizeof(T)));
+    }
+
+    void deallocate(T* p, size_t n) {
+        if (n == 1)
+            pool->deallocate(p, sizeof(T));
+        else
+            ::operator delete(p);
+    }
+
+    // Frees all of the pool's blocks at once, see NodePool::release
+    void release() {
+        pool->release();
+    }
+};
+
+template <typename T, typename U>
+bool operator==(const PoolAllocator<T>& a, const PoolAllocator<U>& b) {
+    return a.pool == b.pool;
+}
+
+template <typename T, typename U>
+bool operator!=(const PoolAllocator<T>& a, const PoolAllocator<U>& b) {
+    return a.pool != b.pool;
+}
+
+// Lets a container hand a pooled allocator's memory back in one go, other allocators have nothing to release
+template <typename Alloc>
+void release_pool(Alloc&) {}
+
+template <typename T>
+void release_pool(PoolAllocator<T>& alloc) {
+    alloc.release();
+}
+
+#endif //__POOL_ALLOCATOR_H
@@ -2,10 +2,22 @@
 #define __PROBING_HASH_H
 
 #include <vector>
+#include <algorithm>
 #include <stdexcept>
 #include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <string>
+#include <fstream>
+#include <memory>
+#include <type_traits>
 
 #include "Hash.h"
+#include "HashPolicy.h"
+#include "HashStats.h"
+#include "HashIterator.h"
+#include "MappedFile.h"
 
 using std::vector;
 using std::pair;
@@ -17,21 +29,68 @@ enum EntryState {
     DELETED = 2
 };
 
-template<typename K, typename V>
-class ProbingHash : public Hash<K,V> { // derived from Hash
+//
+// Insertion policies for ProbingHash, passed after the reduction policy, e.g.
+//   ProbingHash<int, int, std::hash<int>, PrimeModulo, RobinHoodProbing>
+//
+struct LinearProbing {}; //a pair goes in the first empty bucket after its home, the original behavior
+
+//
+// Robin Hood hashing: every full bucket knows how far its pair sits from its home bucket, and an
+// insert takes the bucket of any pair that is closer to home than the one being inserted, which
+// then moves on in its place. A cluster ends up sorted by home bucket, so a lookup can stop as soon
+// as it is further from home than the pair in the bucket it's looking at, instead of walking to the
+// end of the cluster. Probe lengths stay short and even at high load factors.
+//
+struct RobinHoodProbing {};
+
+//
+// Linear probing hash table - derived from StaticHash
+//  Erase shifts the rest of the cluster back instead of leaving DELETED markers, so a cluster only
+//  ever holds VALID buckets and a miss stops at the first EMPTY bucket.
+//  Buckets are stored as three parallel arrays: one byte of EntryState per bucket, then the keys,
+//  then the values. Probing only walks the dense state bytes and compares keys, the value array
+//  is only touched once the key has been found.
+//  With RobinHoodProbing the state byte of a full bucket holds its pair's distance from home plus one
+//  instead of VALID, so misses are turned down from the state bytes alone.
+//  save() writes the three arrays to a file that open_mapped() can later search in place (see MappedFile.h).
+//  HashFn is the hash functor and Reduce is the policy that maps a hash onto a bucket (see HashPolicy.h),
+//  the hash is mixed first unless Reduce mixes it (see spread). Probing is LinearProbing or RobinHoodProbing (above)
+//
+template<typename K, typename V, typename HashFn = std::hash<K>, typename Reduce = PrimeModulo, typename Probing = LinearProbing>
+class ProbingHash : public StaticHash<ProbingHash<K,V,HashFn,Reduce,Probing>, K, V> { // derived from StaticHash
 private:
-    vector<pair<K,EntryState>> array;
+    static const bool robinHood = std::is_same<Probing, RobinHoodProbing>::value;
+    static const unsigned char FAR = 255; //state of a Robin Hood pair FAR - 1 or more buckets from home, the exact distance comes from its key
+
+    MappedArray<unsigned char> states; //EntryState of each bucket, or EMPTY and distance + 1 with Robin Hood
+    MappedArray<K> keys;
+    MappedArray<V> values;
     int s; //size of table
+    HashFn hashFunction;
+    Reduce reduce;
+    LoadPolicy limits; //see HashPolicy.h
+    HASH_STATS_ONLY(StatsCounters counters;)
+
+    friend class StaticHash<ProbingHash, K, V>;
+    friend class SlotIterator<ProbingHash, K, V>;
 
 public:
-    ProbingHash(int n = 101) {
-        array.resize(n);
+    typedef HashFn hasher;
+    typedef SlotIterator<ProbingHash, K, V> iterator; //see HashIterator.h
+
+    ProbingHash(int n = 101) : limits(0.75, true) {
+        n = reduce.bucketsFor(n);
+        reduce.resize(n);
+        states.resize(n);
+        keys.resize(n);
+        values.resize(n);
         makeEmpty(); //initialize all spots to empty
     }
 
     void makeEmpty(){
-        for (auto& item: array){
-            item.second = EMPTY;
+        for (auto& state: states){
+            state = EMPTY;
         }
         s = 0;
     }
@@ -41,7 +100,7 @@ public:
     }
 
     bool empty() {
-        return array.empty();
+        return states.empty();
     }
 
     int size() {
@@ -49,39 +108,25 @@ public:
     }
 
     V& at(const K& key) {
-        int index = hash(key), i=0;
-        while (array[index + i].second != EMPTY){ //while we haven't seen an empty bucket
-            if (array[index + i].first == key)
-                return array[index + i].second; //if keys match return the corresponding value
-            i++;
-            if (i == bucket_count()) 
-                i = -1 * index; //moves the index to the beginning of the array so it doesn't go beyond the array's bounds
-        }
-        cout << "Key not in hash" << endl;
+        return valueAt(find(key, hashFunction(key)));
+    }
+
+    template<typename Q>
+    typename IfTransparent<HashFn, Q, V&>::type at(const Q& key) {
+        return valueAt(find(key, hashFunction(key)));
     }
 
     V& operator[](const K& key) {
-        int index = hash(key), i=0;
-        while (array[index + i].second != EMPTY){ //while we haven't seen an empty bucket
-            if (array[index + i].first == key)
-                return array[index + i].second; //if keys match return the corresponding value
-            i++;
-            if (i == bucket_count()) //
-                i = -1 * index; //moves the index to the beginning of the array so it doesn't go beyond the array's bounds
-        }
-        cout << "Key not in hash" << endl;
+        return at(key);
     }
 
     int count(const K& key) {
-        int index = hash(key), i=0, total=0;
-        while (array[index + i].second != EMPTY){ //while we haven't seen an empty bucket
-            if (array[index + i].first == key) //if we find a key matching the given value increment the total
-                total++;
-            i++;
-            if (i == bucket_count()) 
-                i = -1 * index; //moves the index to the beginning of the array so it doesn't go beyond the array's bounds
-        }
-        return total;
+        return count_with_hash(key, hashFunction(key));
+    }
+
+    template<typename Q>
+    typename IfTransparent<HashFn, Q, int>::type count(const Q& key) {
+        return count_with_hash(key, hashFunction(key));
     }
 
     void emplace(K key, V value) {
@@ -89,117 +134,390 @@ public:
     }
 
     void insert(const std::pair<K, V>& pair) {
-        int index = hash(pair.first), i=0;
-        while (array[index + i].second != EMPTY){ //while there isn't an empty bucket, increment by 1 (linear probing)
-            i++;
-            if (i == bucket_count()) 
-                i = -1 * index; //moves the index to the beginning of the array so it doesn't go beyond the array's bounds
-        }
-        array[index + i] = {pair.first, VALID}; //insert the pair in the empty bucket
-        s++;
-        if (load_factor() > 0.75) //rehash if above load factor
-            rehash();
+        insert_with_hash(pair, hashFunction(pair.first));
     }
 
     void erase(const K& key) {
-        int index = hash(key), i=0;
-        while (array[index + i].first != key){ //while the current index isn't the pair we're looking for, increment by 1 (linear probing)
-            if (array[index + i].second == EMPTY){ //if we reach an empty spot, the key doesn't exist, return
-                cout << "Key not in hash" << endl;
-                return;
-            }
-            i++;
-            if (i == bucket_count())
-                i = -1 * index; //moves the index to the beginning of the array so it doesn't go beyond the array's bounds
-        }
-        array[index + i].second == DELETED; //mark the targeted pair as deleted (lazy deletion)
-        s--;
+        erase_with_hash(key, hashFunction(key));
+    }
+
+    template<typename Q>
+    typename IfTransparent<HashFn, Q, void>::type erase(const Q& key) {
+        erase_with_hash(key, hashFunction(key));
     }
 
     void clear() {
-        array.clear();
+        states.clear();
+        keys.clear();
+        values.clear();
         s = 0;
     }
 
     int bucket_count() {
-        return array.capacity();
+        return states.size();
     }
 
     int bucket_size(int n) {
-        return array[n].second == VALID ? 1 : 0;
+        return states[n] != EMPTY ? 1 : 0;
     }
 
     int bucket(const K& key) {
-        int index = hash(key), i=0;
-        while (array[index + i].second != EMPTY){ //while we haven't seen an empty bucket
-            if (array[index + i].first == key)
-                return index + i; //if the keys match, return the position
-            i++;
-            if (i == bucket_count())
-                i = -1 * index; //moves the index to the beginning of the array so it doesn't go beyond the array's bounds
-        }
-        cout << "Key not in hash" << endl;
-        return -1; //return invalid position if pair can't be found
+        return bucket_with_hash(key, hashFunction(key));
+    }
+
+    template<typename Q>
+    typename IfTransparent<HashFn, Q, int>::type bucket(const Q& key) {
+        return bucket_with_hash(key, hashFunction(key));
     }
 
     float load_factor() {
-        return ((float)s/(float)array.capacity());
+        return ((float)s/(float)states.size());
     }
 
     void rehash() {
-        vector<pair<K,EntryState>> oldArray = array;
+        rehash(limits.grown(bucket_count(), s + 1)); //grow by the growth factor
+    }
 
-        array.resize(findNextPrime(2 * array.capacity())); //double current size and find prime
+    void rehash(int n) {
+        HASH_STATS_ONLY(counters.rehashed(); RehashTimer timer(counters));
+        MappedArray<unsigned char> oldStates; //take the arrays out without copying them, a mapped file stays mapped until they go
+        MappedArray<K> oldKeys;
+        MappedArray<V> oldValues;
+        oldStates.swap(states);
+        oldKeys.swap(keys);
+        oldValues.swap(values);
+
+        n = reduce.bucketsFor(std::max(n, limits.bucketsFor(s))); //never fewer buckets than the pairs need, place() has to find an EMPTY one
+        reduce.resize(n);
+        states.assign(n, EMPTY);
+        keys.resize(n);
+        values.resize(n);
+
+        for (int i = 0; i < (int)oldStates.size(); i++){ //iterate through entire old array
+            if (oldStates[i] != EMPTY) //if item is valid, probe for its new bucket directly, the size doesn't change
+                place(hash(oldKeys[i]), std::move(oldKeys[i]), std::move(oldValues[i])); //move into newly resized array
+        }
+    }
 
-        makeEmpty(); //make all states empty //size is reset in function as well
+    void reserve(int n) {
+        int needed = limits.bucketsFor(n); //buckets needed to hold n elements without going over the max load factor
+        if (needed > bucket_count())
+            rehash(needed);
+    }
+
+    HashStats stats() {
+        HashStats stats;
+        HASH_STATS_ONLY(counters.fill(stats));
+        clusterHistogram(bucket_count(), [this](int i) { return states[i] != EMPTY; }, stats.clusterSizes);
+        return stats; //erase shifts pairs back, so there are never any tombstones
+    }
 
-        for (auto& item: oldArray){ //iterate through entire old array
-            if (item.second == VALID) //if item is valid
-                insert(std::move(item)); //move into newly resized array
+    // Writes the table to path in the format open_mapped reads: a FileHeader, then the state bytes, the
+    // keys and the values, each starting on a 64 byte boundary. The header only holds offsets from the
+    // start of the file, never pointers. The file is written next to path and then renamed over it, so a
+    // process that has the old file mapped keeps its copy. Throws std::runtime_error if it can't be written.
+    void save(const std::string& path) {
+        static_assert(std::is_trivially_copyable<K>::value && std::is_trivially_copyable<V>::value,
+                      "save and open_mapped copy keys and values byte for byte");
+        FileHeader header = fileHeader(bucket_count());
+        header.size = s;
+        std::string temp = path + ".tmp";
+        std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+        writeAt(out, 0, &header, sizeof header);
+        writeAt(out, header.statesOffset, states.data(), bucket_count());
+        writeAt(out, header.keysOffset, keys.data(), bucket_count() * sizeof(K));
+        writeAt(out, header.valuesOffset, values.data(), bucket_count() * sizeof(V));
+        out.close();
+        if (!out || std::rename(temp.c_str(), path.c_str()) != 0){
+            std::remove(temp.c_str());
+            throw std::runtime_error("Can't write " + path);
         }
     }
 
-    void rehash(int n) {
-        vector<pair<K,EntryState>> oldArray = array;
+    // Replaces the contents of the table with a file written by save, without reading it: the arrays
+    // point straight into the mapped file and a page is only read from disk when a probe touches it.
+    // The table can still be changed, a written page gets a private copy and the file stays as it was,
+    // and the first rehash moves everything into memory. HashFn must hash keys the same way it did in the
+    // process that saved the file. Throws std::runtime_error if path isn't a save of this kind of table.
+    void open_mapped(const std::string& path) {
+        static_assert(std::is_trivially_copyable<K>::value && std::is_trivially_copyable<V>::value,
+                      "save and open_mapped copy keys and values byte for byte");
+        std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>(path);
+        FileHeader header;
+        if (file->size() < sizeof header)
+            throw std::runtime_error(path + " is not a ProbingHash file");
+        std::memcpy(&header, file->data(), sizeof header);
+        FileHeader expected = fileHeader(header.buckets);
+        expected.size = header.size;
+        if (std::memcmp(&header, &expected, sizeof header) != 0 || header.fileSize > file->size()
+            || header.buckets > INT32_MAX || header.size > header.buckets
+            || (header.buckets > 0 && reduce.bucketsFor(header.buckets) != (int)header.buckets)) //saved with a different Reduce policy
+            throw std::runtime_error(path + " is not a ProbingHash file for this table type");
+        if (header.buckets > 0) //a cleared table has no buckets, like after clear()
+            reduce.resize(header.buckets);
+        states.map(file, header.statesOffset, header.buckets);
+        keys.map(file, header.keysOffset, header.buckets);
+        values.map(file, header.valuesOffset, header.buckets);
+        s = header.size;
+    }
 
-        array.resize(findNextPrime(n)); //find next prime after given value
+    iterator begin() {
+        return iteratorAt(0);
+    }
 
-        makeEmpty(); //make all states empty //size is reset in function as well
+    iterator end() {
+        return iterator(this, bucket_count());
+    }
+
+    HashFn hash_function() {
+        return hashFunction;
+    }
+
+    // Lookups and inserts with a hash the caller already has, h must be hash_function()(key). Callers that
+    // hash a key once for several tables, or keep the hash next to the key, skip hashing it again.
+    // find_with_hash returns the key's value, or nullptr.
+    template<typename Q>
+    V* find_with_hash(const Q& key, size_t h) {
+        int index = find(key, h);
+        return index == -1 ? nullptr : &values[index];
+    }
+
+    void insert_with_hash(const std::pair<K, V>& pair, size_t h) {
+        if (limits.overfull(s + 1, bucket_count())) //rehash if it would go above load factor, also gives a cleared table its buckets back
+            rehash();
+        place(home(h), pair.first, pair.second);
+        s++;
+    }
 
-        for (auto& item: oldArray){ //iterate through entire old array
-            if (item.second == VALID) //if item is valid
-                insert(std::move(item)); //move into newly resized array
+    template<typename Q>
+    int count_with_hash(const Q& key, size_t h) {
+        int n = bucket_count(), index = home(h), i=0, total=0;
+        while (i < n && states[index] != EMPTY){ //while we haven't seen an empty bucket, a cleared table has none to look at
+            if (robinHood && passed(states[index], i))
+                break;
+            if (mayHold(states[index], i) && keys[index] == key) //if we find a key matching the given value increment the total
+                total++;
+            index = next(index);
+            i++;
         }
+        HASH_STATS_ONLY(counters.lookup(total > 0, i));
+        return total;
+    }
+
+    template<typename Q>
+    int bucket_with_hash(const Q& key, size_t h) {
+        return bucketAt(find(key, h));
+    }
+
+    template<typename Q>
+    void erase_with_hash(const Q& key, size_t h) {
+        eraseAt(find(key, h));
+    }
+
+    void prefetch(size_t h) { //see StaticHash::find_batch, a probe reads the state byte and the key
+        if (bucket_count() == 0)
+            return;
+        int index = home(h);
+        __builtin_prefetch(&states[index]);
+        __builtin_prefetch(&keys[index]);
     }
 
 private:
-    int findNextPrime(int n)
-    {
-        while (!isPrime(n))
-        {
-            n++;
+    // Returns the position of the first bucket holding key, or -1 if it isn't in the table
+    template<typename Q>
+    int find(const Q& key, size_t h) {
+        int n = bucket_count(), index = home(h), i=0;
+        while (i < n && states[index] != EMPTY){ //while we haven't seen an empty bucket, a cleared table has none to look at
+            if (robinHood && passed(states[index], i))
+                break;
+            if (mayHold(states[index], i) && keys[index] == key){
+                HASH_STATS_ONLY(counters.lookup(true, i + 1));
+                return index; //if the keys match, return the position
+            }
+            index = next(index);
+            i++;
         }
-        return n;
+        HASH_STATS_ONLY(counters.lookup(false, i));
+        return -1;
+    }
+
+    V& valueAt(int index) {
+        if (index == -1)
+            throw std::out_of_range("Key not in hash");
+        return values[index]; //if keys match return the corresponding value
     }
 
-    int isPrime(int n)
-    {
-        for (int i = 2; i <= sqrt(n); i++)
-        {
-            if (n % i == 0)
-            {
-                return false;
+    void eraseAt(int index) {
+        if (index == -1) //nothing to erase, like unordered_map::erase
+            return;
+        // Backward shift deletion: walk the rest of the cluster and pull back every pair that is allowed
+        // to sit in the hole, so no DELETED markers are ever left behind to lengthen later probes
+        int n = bucket_count(), hole = index;
+        if (robinHood){ //the cluster is sorted by home, so every pair up to the next one at home moves back one
+            for (int i = next(index); states[i] != EMPTY && states[i] != encode(0); i = next(i)){
+                states[hole] = encode(distance(i) - 1);
+                keys[hole] = std::move(keys[i]);
+                values[hole] = std::move(values[i]);
+                hole = i;
             }
         }
+        else {
+            for (int i = next(index); states[i] != EMPTY; i = next(i)){
+                int home = hash(keys[i]);
+                if ((i - home + n) % n >= (i - hole + n) % n){ //the hole is between this pair's home and where it sits now
+                    keys[hole] = std::move(keys[i]);
+                    values[hole] = std::move(values[i]);
+                    hole = i;
+                }
+            }
+        }
+        states[hole] = EMPTY;
+        s--;
+        if (limits.underfull(s, n))
+            shrink();
+    }
+
+    void shrink() { //only if the policy rounds the smaller size to fewer buckets than there are now
+        int n = reduce.bucketsFor(limits.shrunk(s));
+        if (n < bucket_count())
+            rehash(n);
+    }
+
+    int bucketAt(int index) {
+        if (index == -1)
+            throw std::out_of_range("Key not in hash");
+        return index;
+    }
+
+    iterator iteratorAt(int b) { //first pair in bucket b or after it
+        return iterator(this, nextFull(b));
+    }
+
+    int nextFull(int index) { //erase never leaves DELETED behind, so every bucket is EMPTY or full
+        int n = bucket_count();
+        for (; index + 8 <= n; index += 8){ //step over 8 EMPTY buckets at a time
+            uint64_t word;
+            std::memcpy(&word, &states[index], 8);
+            if (word != 0)
+                break;
+        }
+        while (index < n && states[index] == EMPTY)
+            index++;
+        return index;
+    }
+
+    K& slotKey(int index) {
+        return keys[index];
+    }
 
-        return true;
+    V& slotValue(int index) {
+        return values[index];
+    }
+
+    // Puts key in the first bucket it can have at or after its home bucket index. Linear probing takes the
+    // first empty one, Robin Hood swaps it with every pair on the way that is closer to home and carries
+    // that pair on instead. Doesn't count it or rehash.
+    void place(int index, K key, V value) {
+        if (!robinHood){
+            while (states[index] != EMPTY) //while there isn't an empty bucket, increment by 1 (linear probing)
+                index = next(index);
+            states[index] = VALID; //insert the pair in the empty bucket
+            keys[index] = std::move(key);
+            values[index] = std::move(value);
+            return;
+        }
+        int d = 0; //distance of the carried pair from its home
+        for (; states[index] != EMPTY; index = next(index), d++){
+            int resident = distance(index);
+            if (resident < d){ //richer than the carried pair, so it gives up the bucket
+                std::swap(key, keys[index]);
+                std::swap(value, values[index]);
+                states[index] = encode(d);
+                d = resident;
+            }
+        }
+        states[index] = encode(d);
+        keys[index] = std::move(key);
+        values[index] = std::move(value);
+    }
+
+    // Robin Hood only: a state byte holds distance + 1, up to FAR
+    static unsigned char encode(int d) {
+        return d < FAR - 1 ? d + 1 : FAR;
+    }
+
+    int distance(int index) { //how far the pair in full bucket index is from its home
+        if (states[index] != FAR)
+            return states[index] - 1;
+        return (index - hash(keys[index]) + bucket_count()) % bucket_count();
+    }
+
+    // A probe that is i buckets from home has passed every bucket the key could be in once it reaches a
+    // pair that is closer to its own home (state byte alone, a FAR pair never ends the probe)
+    static bool passed(unsigned char state, int i) {
+        return state != FAR && state - 1 < i;
+    }
+
+    // Whether the bucket can hold the key a probe i buckets from home is looking for. With Robin Hood only
+    // a pair exactly i from home can, so most buckets are ruled out without reading their key.
+    static bool mayHold(unsigned char state, int i) {
+        return !robinHood || state == encode(i);
+    }
+
+    // File layout written by save. Changing it means bumping FILE_VERSION.
+    static const uint32_t FILE_VERSION = 3;
+
+    struct FileHeader {
+        char magic[8]; //"PROBHASH"
+        uint32_t version;
+        uint32_t byteOrder; //0x01020304 as the saving machine stores it, files don't move between byte orders
+        uint32_t keySize, valueSize;
+        uint32_t probing, unused; //1 for Robin Hood state bytes
+        uint64_t buckets, size;
+        uint64_t statesOffset, keysOffset, valuesOffset, fileSize;
+    };
+
+    static FileHeader fileHeader(uint64_t buckets) { //everything but the size, which only save knows
+        FileHeader header;
+        std::memset(&header, 0, sizeof header);
+        std::memcpy(header.magic, "PROBHASH", 8);
+        header.version = FILE_VERSION;
+        header.byteOrder = 0x01020304;
+        header.keySize = sizeof(K);
+        header.valueSize = sizeof(V);
+        header.probing = robinHood ? 1 : 0;
+        header.buckets = buckets;
+        header.statesOffset = align(sizeof header);
+        header.keysOffset = align(header.statesOffset + buckets);
+        header.valuesOffset = align(header.keysOffset + buckets * sizeof(K));
+        header.fileSize = header.valuesOffset + buckets * sizeof(V);
+        return header;
+    }
+
+    static uint64_t align(uint64_t offset) { //up to a cache line, which also covers the alignment of K and V
+        return (offset + 63) & ~(uint64_t)63;
+    }
+
+    static void writeAt(std::ofstream& out, uint64_t offset, const void* data, uint64_t length) {
+        static const char zeros[64] = {};
+        if (!out)
+            return; //save reports the failure once the file is closed
+        out.write(zeros, offset - out.tellp()); //padding up to offset, always less than 64 bytes
+        out.write(static_cast<const char*>(data), length);
+    }
+
+    int next(int index) {
+        return index + 1 == bucket_count() ? 0 : index + 1; //wrap around to the beginning of the array
     }
 
     int hash(const K& key) {
-        std::hash<K> hashFunction;
-        return hashFunction(key) % this->bucket_count();       
+        return home(hashFunction(key));
     }
-    
+
+    int home(size_t h) { //home bucket of hash h, see spread in HashPolicy.h
+        return reduce(spread<Reduce>(h));
+    }
+
 };
 
 #endif //__PROBING_HASH_H
@@ -0,0 +1,372 @@
+#ifndef __SHARDED_HASH_H
+#define __SHARDED_HASH_H
+
+#include <vector>
+#include <memory>
+#include <stdexcept>
+#include <functional>
+#include <iterator>
+#include <algorithm>
+#include <omp.h>
+
+#include "Hash.h"
+#include "HashPolicy.h"
+#include "HashStats.h"
+#include "ProbingHash.h"
+
+using std::vector;
+using std::pair;
+
+//
+// Hash table made of 2^k independent Inner tables (shards), safe to use from many OpenMP threads at once.
+//  - keys are hashed once with Inner's hash functor, the high bits of the mixed hash pick the shard
+//    and the hash is handed on to the Inner table (find_with_hash), whose reduce policy looks at the low bits
+//  - every shard has its own lock, and grows on its own when its Inner table decides to rehash, so
+//    a rehash only stalls the threads that want that one shard instead of the whole table
+//  - Inner can be any single threaded Hash, e.g. ProbingHash<K,V> or ChainingHash<K,V>
+//  Buckets are numbered shard by shard: shard 0's buckets first, then shard 1's and so on, so the
+//  bucket of a key changes whenever a shard before it grows.
+//  at() and find_with_hash point into the key's shard, which an insert or erase on another thread can
+//  rehash as soon as the shard lock is let go, so only use them while no other thread writes. lookup
+//  copies the value out while it still holds the lock.
+//
+template<typename K, typename V, typename Inner = ProbingHash<K,V>>
+class ShardedHash : public StaticHash<ShardedHash<K,V,Inner>, K, V> { // derived from StaticHash
+public:
+    typedef typename Inner::hasher hasher;
+
+private:
+    typedef hasher HashFn;
+
+    struct Shard {
+        Inner table;
+        omp_lock_t lock;
+
+        Shard(int n) : table(n) {
+            omp_init_lock(&lock);
+        }
+
+        ~Shard() {
+            omp_destroy_lock(&lock);
+        }
+    };
+
+    vector<std::unique_ptr<Shard>> shards; //each one is allocated on its own, so two shards never share a cache line
+    int shardBits; //there are 2^shardBits shards
+    HashFn hashFunction;
+
+public:
+    // n is the bucket count of the whole table, split evenly across the shards. shardBits < 0 picks
+    // enough shards that two threads rarely want the same one.
+    ShardedHash(int n = 101, int shardBits = -1) : shardBits(shardBits) {
+        if (this->shardBits < 0){
+            this->shardBits = 4;
+            while ((1 << this->shardBits) < 4 * omp_get_max_threads())
+                this->shardBits++;
+        }
+        int numShards = 1 << this->shardBits;
+        for (int i = 0; i < numShards; i++)
+            shards.emplace_back(new Shard(n / numShards + 1));
+    }
+
+    ~ShardedHash() {
+        this->clear();
+    }
+
+    bool empty() {
+        bool empty = true;
+        for (auto& shard : shards){
+            omp_set_lock(&shard->lock);
+            empty = empty && shard->table.empty();
+            omp_unset_lock(&shard->lock);
+        }
+        return empty;
+    }
+
+    int size() {
+        int total = 0;
+        for (auto& shard : shards){
+            omp_set_lock(&shard->lock);
+            total += shard->table.size();
+            omp_unset_lock(&shard->lock);
+        }
+        return total;
+    }
+
+    V& at(const K& key) {
+        return valueOf(find_with_hash(key, hashFunction(key)));
+    }
+
+    template<typename Q>
+    typename IfTransparent<HashFn, Q, V&>::type at(const Q& key) {
+        return valueOf(find_with_hash(key, hashFunction(key)));
+    }
+
+    V& operator[](const K& key) {
+        return at(key);
+    }
+
+    int count(const K& key) {
+        return count_with_hash(key, hashFunction(key));
+    }
+
+    template<typename Q>
+    typename IfTransparent<HashFn, Q, int>::type count(const Q& key) {
+        return count_with_hash(key, hashFunction(key));
+    }
+
+    void emplace(K key, V value) {
+        insert({key,value}); //use insert as helper
+    }
+
+    void insert(const std::pair<K, V>& pair) {
+        insert_with_hash(pair, hashFunction(pair.first));
+    }
+
+    void erase(const K& key) {
+        erase_with_hash(key, hashFunction(key));
+    }
+
+    template<typename Q>
+    typename IfTransparent<HashFn, Q, void>::type erase(const Q& key) {
+        erase_with_hash(key, hashFunction(key));
+    }
+
+    void clear() {
+        for (auto& shard : shards){
+            omp_set_lock(&shard->lock);
+            shard->table.clear();
+            omp_unset_lock(&shard->lock);
+        }
+    }
+
+    int bucket_count() {
+        return offsetOf(shards.size());
+    }
+
+    int bucket_size(int n) {
+        for (auto& shard : shards){
+            omp_set_lock(&shard->lock);
+            int buckets = shard->table.bucket_count();
+            int size = n < buckets ? shard->table.bucket_size(n) : -1;
+            omp_unset_lock(&shard->lock);
+            if (size != -1)
+                return size;
+            n -= buckets; //bucket n is in a later shard
+        }
+        throw std::out_of_range("Bucket not in hash");
+    }
+
+    int bucket(const K& key) {
+        return bucket_with_hash(key, hashFunction(key));
+    }
+
+    template<typename Q>
+    typename IfTransparent<HashFn, Q, int>::type bucket(const Q& key) {
+        return bucket_with_hash(key, hashFunction(key));
+    }
+
+    float load_factor() {
+        return ((float)size()/(float)bucket_count());
+    }
+
+    void rehash() {
+        rehash(bucket_count() * growth_factor()); //grow by the shards' growth factor
+    }
+
+    void rehash(int n) {
+        for (auto& shard : shards){
+            omp_set_lock(&shard->lock);
+            int needed = shard->table.size() / shard->table.max_load_factor() + 1; //a shard may hold more than its share
+            shard->table.rehash(std::max<int>(n / shards.size() + 1, needed)); //every shard gets an even share, or what its pairs need
+            omp_unset_lock(&shard->lock);
+        }
+    }
+
+    void reserve(int n) {
+        int share = n / shards.size();
+        share += share / 8 + 1; //keys don't split perfectly evenly, leave room so the busier shards don't rehash right away
+        for (auto& shard : shards){
+            omp_set_lock(&shard->lock);
+            shard->table.reserve(share);
+            omp_unset_lock(&shard->lock);
+        }
+    }
+
+    // The load limits live in the shards, the setters change every shard and the getters read shard 0
+    float max_load_factor() {
+        return shards[0]->table.max_load_factor();
+    }
+
+    void max_load_factor(float f) {
+        forEachShard([f](Inner& table) { table.max_load_factor(f); });
+    }
+
+    float growth_factor() {
+        return shards[0]->table.growth_factor();
+    }
+
+    void growth_factor(float f) {
+        forEachShard([f](Inner& table) { table.growth_factor(f); });
+    }
+
+    float min_load_factor() {
+        return shards[0]->table.min_load_factor();
+    }
+
+    void min_load_factor(float f) {
+        forEachShard([f](Inner& table) { table.min_load_factor(f); });
+    }
+
+    HashStats stats() {
+        HashStats stats;
+        for (auto& shard : shards){
+            omp_set_lock(&shard->lock);
+            stats.merge(shard->table.stats());
+            omp_unset_lock(&shard->lock);
+        }
+        return stats;
+    }
+
+    HashFn hash_function() {
+        return hashFunction;
+    }
+
+    // Lookups and inserts with a hash the caller already has, h must be hash_function()(key). Callers that
+    // hash a key once for several tables, or keep the hash next to the key, skip hashing it again.
+    // find_with_hash returns the key's value, or nullptr (see the top of the file for when that is safe).
+    template<typename Q>
+    V* find_with_hash(const Q& key, size_t h) {
+        Shard& shard = shardOf(h);
+        omp_set_lock(&shard.lock);
+        V* value = shard.table.find_with_hash(key, h);
+        omp_unset_lock(&shard.lock);
+        return value;
+    }
+
+    // Hides StaticHash's version with one that copies the value before letting go of the shard
+    template<typename Q>
+    bool lookup_with_hash(const Q& key, size_t h, V& value) {
+        Shard& shard = shardOf(h);
+        omp_set_lock(&shard.lock);
+        bool found = shard.table.lookup_with_hash(key, h, value);
+        omp_unset_lock(&shard.lock);
+        return found;
+    }
+
+    void insert_with_hash(const std::pair<K, V>& pair, size_t h) {
+        Shard& shard = shardOf(h);
+        omp_set_lock(&shard.lock);
+        shard.table.insert_with_hash(pair, h); //a rehash here only holds up this shard
+        omp_unset_lock(&shard.lock);
+    }
+
+    template<typename Q>
+    int count_with_hash(const Q& key, size_t h) {
+        Shard& shard = shardOf(h);
+        omp_set_lock(&shard.lock);
+        int total = shard.table.count_with_hash(key, h);
+        omp_unset_lock(&shard.lock);
+        return total;
+    }
+
+    template<typename Q>
+    int bucket_with_hash(const Q& key, size_t h) {
+        int s = shardIndex(h);
+        int offset = offsetOf(s);
+        omp_set_lock(&shards[s]->lock);
+        int index;
+        try {
+            index = shards[s]->table.bucket_with_hash(key, h);
+        }
+        catch (...){ //the key isn't in the hash
+            omp_unset_lock(&shards[s]->lock);
+            throw;
+        }
+        omp_unset_lock(&shards[s]->lock);
+        return offset + index;
+    }
+
+    template<typename Q>
+    void erase_with_hash(const Q& key, size_t h) {
+        Shard& shard = shardOf(h);
+        omp_set_lock(&shard.lock);
+        shard.table.erase_with_hash(key, h);
+        omp_unset_lock(&shard.lock);
+    }
+
+    // Sizes every shard once, then splits the range evenly across the OpenMP threads. Hides
+    // StaticHash::bulk_insert, which inserts one pair at a time.
+    template <typename ForwardIt>
+    void bulk_insert(ForwardIt first, ForwardIt last) {
+        bulkInsert(first, last, typename std::iterator_traits<ForwardIt>::iterator_category());
+    }
+
+    using StaticHash<ShardedHash, K, V>::insert_batch;
+
+    // Hides StaticHash's version with one that splits the pairs across the OpenMP threads
+    void insert_batch(const std::pair<K, V>* pairs, const size_t* hashes, int n) {
+        reserve(size() + n);
+        #pragma omp parallel for schedule(static)
+        for (int i = 0; i < n; i++)
+            insert_with_hash(pairs[i], hashes[i]);
+    }
+
+private:
+    template <typename RandomIt>
+    void bulkInsert(RandomIt first, RandomIt last, std::random_access_iterator_tag) {
+        int n = last - first;
+        reserve(size() + n);
+        #pragma omp parallel for schedule(static)
+        for (int i = 0; i < n; i++)
+            insert(first[i]);
+    }
+
+    template <typename ForwardIt>
+    void bulkInsert(ForwardIt first, ForwardIt last, std::forward_iterator_tag) { //can't be split up front, so copy it into a vector first
+        vector<pair<K,V>> pairs(first, last);
+        bulkInsert(pairs.begin(), pairs.end(), std::random_access_iterator_tag());
+    }
+
+    template <typename F>
+    void forEachShard(F f) { //f(Inner&) on every shard in turn, holding its lock
+        for (auto& shard : shards){
+            omp_set_lock(&shard->lock);
+            try {
+                f(shard->table);
+            }
+            catch (...){ //a setter that turns the value down, the shards all agree so it's always shard 0
+                omp_unset_lock(&shard->lock);
+                throw;
+            }
+            omp_unset_lock(&shard->lock);
+        }
+    }
+
+    V& valueOf(V* value) {
+        if (!value)
+            throw std::out_of_range("Key not in hash");
+        return *value;
+    }
+
+    Shard& shardOf(size_t h) {
+        return *shards[shardIndex(h)];
+    }
+
+    int offsetOf(int s) { //number of buckets in the shards before shard s
+        int total = 0;
+        for (int i = 0; i < s; i++){
+            omp_set_lock(&shards[i]->lock);
+            total += shards[i]->table.bucket_count();
+            omp_unset_lock(&shards[i]->lock);
+        }
+        return total;
+    }
+
+    int shardIndex(size_t h) { //from the top bits of the mixed hash, so the Inner table's low bits stay independent
+        return shardBits == 0 ? 0 : mix64(h) >> (64 - shardBits);
+    }
+
+};
+
+#endif //__SHARDED_HASH_H
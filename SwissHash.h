@@ -0,0 +1,419 @@
+#ifndef __SWISS_HASH_H
+#define __SWISS_HASH_H
+
+#include <vector>
+#include <stdexcept>
+#include <cstdint>
+#include <functional>
+#include <algorithm>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "Hash.h"
+#include "HashPolicy.h"
+#include "HashStats.h"
+#include "HashIterator.h"
+
+using std::vector;
+using std::pair;
+
+//
+// Open addressing hash table that probes 16 buckets at a time (Swiss table style) - derived from StaticHash
+//  - every bucket has a control byte: EMPTY/DELETED have the high bit set, a full bucket stores the
+//    low 7 bits of its key's hash (the tag)
+//  - buckets are split into groups of 16, a lookup loads a group's 16 control bytes and compares them
+//    against the tag all at once, keys are only compared for buckets whose tag matched
+//  - a lookup stops at the first group that still has an EMPTY bucket
+//  - the number of groups is always a power of 2, groups are visited in triangular order so every
+//    group is reached and there is no wrap-around branch inside a group
+//  HashFn is the hash functor, its result is always mixed before use, so there is no Reduce policy
+//
+template<typename K, typename V, typename HashFn = std::hash<K>>
+class SwissHash : public StaticHash<SwissHash<K,V,HashFn>, K, V> { // derived from StaticHash
+private:
+    static const int GROUP_SIZE = 16;
+    static const signed char CTRL_EMPTY = -128; //0b10000000
+    static const signed char CTRL_DELETED = -2; //0b11111110
+
+    vector<signed char> ctrl; //control byte of each bucket
+    vector<K> keys;
+    vector<V> values;
+    int s; //size of table
+    int deleted; //buckets holding CTRL_DELETED, they count against the load until the next rehash
+    HashFn hashFunction;
+    LoadPolicy limits; //see HashPolicy.h, the load counts DELETED buckets as well
+    HASH_STATS_ONLY(StatsCounters counters;)
+
+    friend class StaticHash<SwissHash, K, V>;
+    friend class SlotIterator<SwissHash, K, V>;
+
+public:
+    typedef HashFn hasher;
+    typedef SlotIterator<SwissHash, K, V> iterator; //see HashIterator.h
+
+    SwissHash(int n = 128) : limits(0.875, true) {
+        resize(groupsFor(n));
+    }
+
+    ~SwissHash() {
+        this->clear();
+    }
+
+    bool empty() {
+        return ctrl.empty();
+    }
+
+    int size() {
+        return s;
+    }
+
+    V& at(const K& key) {
+        return valueAt(find(key, mix(key)));
+    }
+
+    template<typename Q>
+    typename IfTransparent<HashFn, Q, V&>::type at(const Q& key) {
+        return valueAt(find(key, mix(key)));
+    }
+
+    V& operator[](const K& key) {
+        return at(key);
+    }
+
+    int count(const K& key) {
+        return count_with_hash(key, hashFunction(key));
+    }
+
+    template<typename Q>
+    typename IfTransparent<HashFn, Q, int>::type count(const Q& key) {
+        return count_with_hash(key, hashFunction(key));
+    }
+
+    void emplace(K key, V value) {
+        insert({key,value}); //use insert as helper
+    }
+
+    void insert(const std::pair<K, V>& pair) {
+        insert_with_hash(pair, hashFunction(pair.first));
+    }
+
+    void erase(const K& key) {
+        erase_with_hash(key, hashFunction(key));
+    }
+
+    template<typename Q>
+    typename IfTransparent<HashFn, Q, void>::type erase(const Q& key) {
+        erase_with_hash(key, hashFunction(key));
+    }
+
+    void clear() {
+        ctrl.clear();
+        keys.clear();
+        values.clear();
+        s = 0;
+        deleted = 0;
+    }
+
+    int bucket_count() {
+        return ctrl.size();
+    }
+
+    int bucket_size(int n) {
+        return ctrl[n] >= 0 ? 1 : 0;
+    }
+
+    int bucket(const K& key) {
+        return bucket_with_hash(key, hashFunction(key));
+    }
+
+    template<typename Q>
+    typename IfTransparent<HashFn, Q, int>::type bucket(const Q& key) {
+        return bucket_with_hash(key, hashFunction(key));
+    }
+
+    float load_factor() {
+        return ((float)s/(float)ctrl.size());
+    }
+
+    void rehash() {
+        rehash(limits.grown(bucket_count(), s + 1));
+    }
+
+    // Resizes to at least n buckets, rounded up to a power of 2 number of groups
+    void rehash(int n) {
+        HASH_STATS_ONLY(counters.rehashed(); RehashTimer timer(counters));
+        vector<signed char> oldCtrl;
+        vector<K> oldKeys;
+        vector<V> oldValues;
+        oldCtrl.swap(ctrl);
+        oldKeys.swap(keys);
+        oldValues.swap(values);
+
+        resize(groupsFor(n < s ? s : n));
+
+        for (int i = 0; i < (int)oldCtrl.size(); i++){
+            if (oldCtrl[i] >= 0){ //full bucket, the table is big enough so no need to check the load
+                size_t h = mix(oldKeys[i]);
+                int index = findFree(h);
+                ctrl[index] = h & 0x7F;
+                keys[index] = std::move(oldKeys[i]);
+                values[index] = std::move(oldValues[i]);
+                s++;
+            }
+        }
+    }
+
+    void reserve(int n) {
+        int needed = limits.bucketsFor(n); //buckets needed to hold n elements without going over the max load factor
+        if (needed > bucket_count()) //tombstones are left to the compaction in insert and erase
+            rehash(needed);
+    }
+
+    HashStats stats() {
+        HashStats stats;
+        HASH_STATS_ONLY(counters.fill(stats));
+        clusterHistogram(bucket_count(), [this](int i) { return ctrl[i] != CTRL_EMPTY; }, stats.clusterSizes);
+        stats.tombstones = deleted;
+        return stats;
+    }
+
+    iterator begin() {
+        return iteratorAt(0);
+    }
+
+    iterator end() {
+        return iterator(this, bucket_count());
+    }
+
+    HashFn hash_function() {
+        return hashFunction;
+    }
+
+    // Lookups and inserts with a hash the caller already has, h must be hash_function()(key). Callers that
+    // hash a key once for several tables, or keep the hash next to the key, skip hashing it again.
+    // find_with_hash returns the key's value, or nullptr.
+    template<typename Q>
+    V* find_with_hash(const Q& key, size_t h) {
+        int index = find(key, mix64(h));
+        return index == -1 ? nullptr : &values[index];
+    }
+
+    void insert_with_hash(const std::pair<K, V>& pair, size_t h) {
+        if (limits.overfull(s + deleted + 1, bucket_count())) //keeps EMPTY buckets around to end probes, max load factor is below 1
+            rehash(limits.compactedOrGrown(bucket_count(), s + 1)); //same size just clears out DELETED
+        h = mix64(h);
+        int index = findFree(h);
+        if (ctrl[index] == CTRL_DELETED)
+            deleted--;
+        ctrl[index] = h & 0x7F;
+        keys[index] = pair.first;
+        values[index] = pair.second;
+        s++;
+    }
+
+    template<typename Q>
+    int count_with_hash(const Q& key, size_t h) {
+        return countWithHash(key, mix64(h));
+    }
+
+    template<typename Q>
+    int bucket_with_hash(const Q& key, size_t h) {
+        return bucketAt(find(key, mix64(h)));
+    }
+
+    template<typename Q>
+    void erase_with_hash(const Q& key, size_t h) {
+        eraseAt(find(key, mix64(h)));
+    }
+
+    void prefetch(size_t h) { //see StaticHash::find_batch, a probe reads the group's control bytes and then a key
+        if (numGroups() == 0) //a cleared table has no groups to mask into
+            return;
+        int base = ((mix64(h) >> 7) & (numGroups() - 1)) * GROUP_SIZE;
+        __builtin_prefetch(&ctrl[base]);
+        __builtin_prefetch(&keys[base]);
+    }
+
+private:
+    int numGroups() {
+        return ctrl.size() / GROUP_SIZE;
+    }
+
+    int groupsFor(int n) {
+        int groups = 1;
+        while (groups * GROUP_SIZE < n)
+            groups *= 2;
+        return groups;
+    }
+
+    void resize(int groups) {
+        ctrl.assign(groups * GROUP_SIZE, CTRL_EMPTY);
+        keys.resize(groups * GROUP_SIZE);
+        values.resize(groups * GROUP_SIZE);
+        s = 0;
+        deleted = 0;
+    }
+
+    // Returns the bucket holding key, or -1 if it isn't in the table. h is the key's mixed hash.
+    template<typename Q>
+    int find(const Q& key, size_t h) {
+        signed char tag = h & 0x7F;
+        int mask = numGroups() - 1, group = (h >> 7) & mask;
+        for (int i = 1; i <= numGroups(); i++){
+            int base = group * GROUP_SIZE;
+            for (unsigned matches = matchTag(base, tag); matches; matches &= matches - 1){
+                int index = base + __builtin_ctz(matches);
+                if (keys[index] == key){
+                    HASH_STATS_ONLY(counters.lookup(true, i));
+                    return index;
+                }
+            }
+            if (matchEmpty(base)){
+                HASH_STATS_ONLY(counters.lookup(false, i));
+                return -1;
+            }
+            group = (group + i) & mask;
+        }
+        HASH_STATS_ONLY(counters.lookup(false, numGroups()));
+        return -1;
+    }
+
+    V& valueAt(int index) {
+        if (index == -1)
+            throw std::out_of_range("Key not in hash");
+        return values[index];
+    }
+
+    template<typename Q>
+    int countWithHash(const Q& key, size_t h) {
+        signed char tag = h & 0x7F;
+        int mask = numGroups() - 1, group = (h >> 7) & mask, total = 0, i;
+        for (i = 1; i <= numGroups(); i++){
+            int base = group * GROUP_SIZE;
+            for (unsigned matches = matchTag(base, tag); matches; matches &= matches - 1){ //walk the set bits
+                int index = base + __builtin_ctz(matches);
+                if (keys[index] == key)
+                    total++;
+            }
+            if (matchEmpty(base)) //nothing was ever pushed past this group
+                break;
+            group = (group + i) & mask; //triangular probing over the groups
+        }
+        HASH_STATS_ONLY(counters.lookup(total > 0, std::min(i, numGroups())));
+        return total;
+    }
+
+    void eraseAt(int index) {
+        if (index == -1) //nothing to erase, like unordered_map::erase
+            return;
+        if (matchEmpty(index - index % GROUP_SIZE)){ //no lookup ever went past this group, so the bucket can just be emptied
+            ctrl[index] = CTRL_EMPTY;
+        }
+        else {
+            ctrl[index] = CTRL_DELETED;
+            deleted++;
+        }
+        s--;
+        if (limits.underfull(s, bucket_count()) && groupsFor(limits.shrunk(s)) < numGroups()) //only if that is fewer groups than now
+            rehash(limits.shrunk(s));
+        else if (deleted > bucket_count() / 4) //compact in place, misses have to walk past every DELETED bucket
+            rehash(bucket_count());
+    }
+
+    int bucketAt(int index) {
+        if (index == -1)
+            throw std::out_of_range("Key not in hash");
+        return index;
+    }
+
+    iterator iteratorAt(int b) { //first pair in bucket b or after it
+        return iterator(this, nextFull(b));
+    }
+
+    int nextFull(int index) { //a group at a time, with the same control byte masks a lookup uses
+        int n = bucket_count();
+        while (index < n){
+            int base = index - index % GROUP_SIZE;
+            unsigned full = ~matchFree(base) & (0xFFFFu << (index - base)) & 0xFFFF;
+            if (full)
+                return base + __builtin_ctz(full);
+            index = base + GROUP_SIZE;
+        }
+        return n;
+    }
+
+    K& slotKey(int index) {
+        return keys[index];
+    }
+
+    V& slotValue(int index) {
+        return values[index];
+    }
+
+    // Returns the first EMPTY or DELETED bucket in h's probe sequence
+    int findFree(size_t h) {
+        int mask = numGroups() - 1, group = (h >> 7) & mask;
+        for (int i = 1; ; i++){
+            int base = group * GROUP_SIZE;
+            unsigned free = matchFree(base);
+            if (free)
+                return base + __builtin_ctz(free);
+            group = (group + i) & mask;
+        }
+    }
+
+#ifdef __SSE2__
+    // Bit i is set when bucket base + i has the given tag
+    unsigned matchTag(int base, signed char tag) {
+        __m128i group = _mm_loadu_si128((const __m128i*)&ctrl[base]);
+        return _mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(tag)));
+    }
+
+    unsigned matchEmpty(int base) {
+        __m128i group = _mm_loadu_si128((const __m128i*)&ctrl[base]);
+        return _mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(CTRL_EMPTY)));
+    }
+
+    unsigned matchFree(int base) { //EMPTY and DELETED are the only control bytes with the high bit set
+        return _mm_movemask_epi8(_mm_loadu_si128((const __m128i*)&ctrl[base]));
+    }
+#else
+    unsigned matchTag(int base, signed char tag) {
+        unsigned bits = 0;
+        for (int i = 0; i < GROUP_SIZE; i++)
+            bits |= (unsigned)(ctrl[base + i] == tag) << i;
+        return bits;
+    }
+
+    unsigned matchEmpty(int base) {
+        return matchTag(base, CTRL_EMPTY);
+    }
+
+    unsigned matchFree(int base) {
+        unsigned bits = 0;
+        for (int i = 0; i < GROUP_SIZE; i++)
+            bits |= (unsigned)(ctrl[base + i] < 0) << i;
+        return bits;
+    }
+#endif
+
+    // std::hash is the identity for integers, so the bits are mixed before taking the tag and group
+    template<typename Q>
+    size_t mix(const Q& key) {
+        return mix64(hashFunction(key));
+    }
+
+    int hash(const K& key) {
+        return ((mix(key) >> 7) & (numGroups() - 1)) * GROUP_SIZE; //first bucket of the key's home group
+    }
+
+};
+
+template<typename K, typename V, typename HashFn>
+const signed char SwissHash<K,V,HashFn>::CTRL_EMPTY;
+
+template<typename K, typename V, typename HashFn>
+const signed char SwissHash<K,V,HashFn>::CTRL_DELETED;
+
+#endif //__SWISS_HASH_H
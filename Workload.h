@@ -0,0 +1,182 @@
+/*
+ *  Key generators and latency sampling shared by the benchmark drivers
+ */
+
+#ifndef __WORKLOAD_H
+#define __WORKLOAD_H
+
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <unordered_set>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+#include <string>
+
+// How the keys stored in a table, and the keys looked up in it, are chosen
+enum KeyDistribution {
+    SEQUENTIAL = 0, //keys 1..n, looked up in order
+    UNIFORM = 1,    //n distinct random keys, looked up uniformly at random
+    ZIPFIAN = 2     //n distinct random keys, a few of them looked up far more often than the rest
+};
+
+inline const char* distributionName(int d) {
+    return d == SEQUENTIAL ? "seq" : d == UNIFORM ? "uniform" : "zipf";
+}
+
+// Splits a comma separated command line list, e.g. --tables=Probing,Swiss
+inline std::vector<std::string> split(const char* list) {
+    std::vector<std::string> items;
+    std::string item;
+    for (const char* c = list; ; c++){
+        if (*c == ',' || *c == '\0'){
+            if (!item.empty())
+                items.push_back(item);
+            item.clear();
+            if (*c == '\0')
+                return items;
+        }
+        else
+            item += *c;
+    }
+}
+
+//
+// Zipfian ranks in [0, n), rank 0 being the most popular. This is the generator YCSB uses
+// (Gray et al., "Quickly Generating Billion-Record Synthetic Databases"): zeta(n) is summed once
+// up front, after that every draw is O(1).
+//
+class ZipfianGenerator {
+private:
+    int n;
+    double theta, alpha, zetan, eta;
+    std::uniform_real_distribution<double> uniform;
+
+public:
+    ZipfianGenerator(int n, double theta = 0.99) : n(n), theta(theta) {
+        double zeta2 = 1 + std::pow(0.5, theta);
+        zetan = 0;
+        for (int i = 1; i <= n; i++)
+            zetan += 1 / std::pow((double)i, theta);
+        alpha = 1 / (1 - theta);
+        eta = (1 - std::pow(2.0 / n, 1 - theta)) / (1 - zeta2 / zetan);
+    }
+
+    template<typename Rng>
+    int operator()(Rng& rng) {
+        double u = uniform(rng);
+        double uz = u * zetan;
+        if (uz < 1)
+            return 0;
+        if (uz < 1 + std::pow(0.5, theta))
+            return 1;
+        int rank = n * std::pow(eta * u - eta + 1, alpha);
+        return rank < n ? rank : n - 1;
+    }
+};
+
+// The n keys a table is filled with. Every key is positive, so any negative key is a guaranteed miss.
+inline std::vector<int> makeKeys(int n, int distribution, unsigned seed = 1) {
+    std::vector<int> keys;
+    keys.reserve(n);
+    if (distribution == SEQUENTIAL){
+        for (int i = 1; i <= n; i++)
+            keys.push_back(i);
+        return keys;
+    }
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<int> dist(1, INT32_MAX);
+    std::unordered_set<int> seen;
+    while ((int)keys.size() < n){
+        int key = dist(rng);
+        if (seen.insert(key).second)
+            keys.push_back(key);
+    }
+    return keys;
+}
+
+//
+// A stream of count lookups against keys, hitPercent of which are for keys in the table and the
+// rest for keys that are not. Which stored key a hit goes to follows the distribution.
+//
+inline std::vector<int> makeLookups(const std::vector<int>& keys, int count, int distribution, int hitPercent, unsigned seed = 2) {
+    std::vector<int> lookups;
+    lookups.reserve(count);
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<int> percent(0, 99), index(0, keys.size() - 1), miss(1, INT32_MAX);
+    ZipfianGenerator zipf(distribution == ZIPFIAN ? keys.size() : 1);
+    for (int i = 0; i < count; i++){
+        if (percent(rng) >= hitPercent)
+            lookups.push_back(-miss(rng));
+        else if (distribution == SEQUENTIAL)
+            lookups.push_back(keys[i % keys.size()]);
+        else if (distribution == UNIFORM)
+            lookups.push_back(keys[index(rng)]);
+        else
+            lookups.push_back(keys[zipf(rng)]); //keys are already in random order, so rank 0 is a random key
+    }
+    return lookups;
+}
+
+// Fixed size value type, so the cost of moving bigger values around can be measured
+template<int N>
+struct Blob {
+    char bytes[N];
+
+    Blob() {}
+
+    explicit Blob(int v) {
+        std::memset(bytes, 0, N);
+        std::memcpy(bytes, &v, sizeof(v) < N ? sizeof(v) : N);
+    }
+};
+
+//
+// Times a sample of single operations and reports percentiles of the samples. Timing every
+// operation would mostly measure the clock, so only one in every SAMPLE_EVERY is timed.
+//
+class LatencySampler {
+public:
+    static const int SAMPLE_EVERY = 64;
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    std::vector<uint32_t> samples; //nanoseconds
+    Clock::time_point start;
+    unsigned ops = 0;
+    bool timing = false;
+
+public:
+    void begin() {
+        timing = ops++ % SAMPLE_EVERY == 0;
+        if (timing)
+            start = Clock::now();
+    }
+
+    void end() {
+        if (timing)
+            samples.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+    }
+
+    void merge(const LatencySampler& other) {
+        samples.insert(samples.end(), other.samples.begin(), other.samples.end());
+    }
+
+    int count() const {
+        return samples.size();
+    }
+
+    // p in [0, 100], 0 when nothing has been sampled
+    double percentile(double p) {
+        if (samples.empty())
+            return 0;
+        size_t rank = std::min(samples.size() - 1, (size_t)(p / 100 * samples.size()));
+        std::nth_element(samples.begin(), samples.begin() + rank, samples.end());
+        return samples[rank];
+    }
+};
+
+#endif //__WORKLOAD_H
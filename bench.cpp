@@ -0,0 +1,244 @@
+/*
+ *  Micro-benchmarks for every Hash implementation (Google Benchmark)
+ *
+ *  make bench                                            --> runs everything, JSON results go to bench.json
+ *  make bench BENCH_ARGS=--benchmark_filter=Find/Swiss   --> only the matching benchmarks
+ *
+ *  Insert/<table>/size/dist/threads     build a table of size keys from empty
+ *  Find/<table>/size/dist/hit           look up keys in a full table, hit percent of them are in it
+ *  FindBatch/<table>/size/dist/hit      the same lookups, BATCH_SIZE keys per find_batch call
+ *  EraseInsert/<table>/size/dist        erase a key and put it straight back, the size stays the same
+ *
+ *  dist is 0 sequential, 1 uniform random, 2 zipfian (see Workload.h). Find and EraseInsert run on
+ *  1..N benchmark threads for the tables that are safe to share, Insert uses that many OpenMP threads.
+ *  All times are wall clock. Besides the time per operation and items_per_second, each run reports
+ *  p50/p99/p999 latency of a sample of single operations.
+ */
+
+#include <benchmark/benchmark.h>
+#include <omp.h>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "ChainingHash.h"
+#include "ProbingHash.h"
+#include "ParallelProbingHash.h"
+#include "ShardedHash.h"
+#include "SwissHash.h"
+#include "CuckooHash.h"
+#include "Workload.h"
+
+static const int LOOKUPS = 1 << 20; //length of a Find lookup stream, a power of 2
+static const int SIZES[] = {1 << 10, 1 << 16, 1 << 20};
+static const int BATCH_SIZE = 64; //keys per find_batch call, about one request's worth of lookups
+
+static void (*releaseShared)() = nullptr; //frees the table built by the last Shared<> so only one is alive
+
+//
+// Full table shared by all threads of a benchmark, and kept between benchmarks on the same table
+// type with the same size and key distribution, since building a big one takes longer than the run
+//
+template<typename Table, typename V>
+struct Shared {
+    static int size, distribution;
+    static std::vector<int> keys;
+    static std::vector<int> lookups;
+    static std::unique_ptr<Table> table;
+
+    static void build(int n, int d) {
+        if (table && size == n && distribution == d)
+            return;
+        if (releaseShared)
+            releaseShared();
+        keys = makeKeys(n, d);
+        table.reset(new Table);
+        table->reserve(n);
+        for (int key : keys)
+            table->insert({key, V(key)});
+        size = n;
+        distribution = d;
+        releaseShared = release;
+    }
+
+    static void release() {
+        table.reset();
+        std::vector<int>().swap(keys);
+        std::vector<int>().swap(lookups);
+        releaseShared = nullptr;
+    }
+};
+
+template<typename Table, typename V> int Shared<Table,V>::size = -1;
+template<typename Table, typename V> int Shared<Table,V>::distribution = -1;
+template<typename Table, typename V> std::vector<int> Shared<Table,V>::keys;
+template<typename Table, typename V> std::vector<int> Shared<Table,V>::lookups;
+template<typename Table, typename V> std::unique_ptr<Table> Shared<Table,V>::table;
+
+static void reportLatency(benchmark::State& state, LatencySampler& sampler) {
+    state.counters["p50_ns"] = benchmark::Counter(sampler.percentile(50), benchmark::Counter::kAvgThreads);
+    state.counters["p99_ns"] = benchmark::Counter(sampler.percentile(99), benchmark::Counter::kAvgThreads);
+    state.counters["p999_ns"] = benchmark::Counter(sampler.percentile(99.9), benchmark::Counter::kAvgThreads);
+}
+
+template<typename Table, typename V>
+static void BM_Insert(benchmark::State& state) {
+    int size = state.range(0), threads = state.range(2);
+    std::vector<int> keys = makeKeys(size, state.range(1));
+    vector<LatencySampler> samplers(threads);
+    for (auto _ : state){
+        Table* table = new Table;
+        #pragma omp parallel for num_threads(threads) if(threads > 1)
+        for (int i = 0; i < size; i++){
+            LatencySampler& sampler = samplers[omp_get_thread_num()];
+            sampler.begin();
+            table->insert({keys[i], V(keys[i])});
+            sampler.end();
+        }
+        state.PauseTiming();
+        delete table;
+        state.ResumeTiming();
+    }
+    for (int t = 1; t < threads; t++)
+        samplers[0].merge(samplers[t]);
+    reportLatency(state, samplers[0]);
+    state.SetItemsProcessed(state.iterations() * size);
+}
+
+// First byte of a value, enough to check that a lookup found the right one
+inline char tagOf(int value) { return value; }
+
+template<int N>
+inline char tagOf(const Blob<N>& value) { return value.bytes[0]; }
+
+// Hits go through at(), misses through count() so the miss isn't timing an exception
+template<typename Table, typename V>
+static void BM_Find(benchmark::State& state) {
+    typedef Shared<Table,V> S;
+    if (state.thread_index() == 0){ //the other threads wait at the start of the loop
+        S::build(state.range(0), state.range(1));
+        S::lookups = makeLookups(S::keys, LOOKUPS, state.range(1), state.range(2));
+    }
+    LatencySampler sampler;
+    long found = 0;
+    int i = state.thread_index() * (LOOKUPS / state.threads());
+    for (auto _ : state){
+        int key = S::lookups[i++ & (LOOKUPS - 1)];
+        sampler.begin();
+        if (key > 0)
+            found += tagOf(S::table->at(key)) == (char)key;
+        else
+            found += S::table->count(key);
+        sampler.end();
+    }
+    benchmark::DoNotOptimize(found);
+    reportLatency(state, sampler);
+    state.SetItemsProcessed(state.iterations());
+}
+
+// Latency samples are per batch, not per key
+template<typename Table, typename V>
+static void BM_FindBatch(benchmark::State& state) {
+    typedef Shared<Table,V> S;
+    if (state.thread_index() == 0){
+        S::build(state.range(0), state.range(1));
+        S::lookups = makeLookups(S::keys, LOOKUPS, state.range(1), state.range(2));
+    }
+    LatencySampler sampler;
+    V* values[BATCH_SIZE];
+    long found = 0;
+    int i = (state.thread_index() * (LOOKUPS / state.threads())) & ~(BATCH_SIZE - 1);
+    for (auto _ : state){
+        const int* keys = &S::lookups[i];
+        sampler.begin();
+        S::table->find_batch(keys, BATCH_SIZE, values);
+        for (int j = 0; j < BATCH_SIZE; j++)
+            found += values[j] ? tagOf(*values[j]) == (char)keys[j] : 0;
+        sampler.end();
+        i = (i + BATCH_SIZE) & (LOOKUPS - 1);
+    }
+    benchmark::DoNotOptimize(found);
+    reportLatency(state, sampler);
+    state.SetItemsProcessed(state.iterations() * BATCH_SIZE);
+}
+
+// Every thread churns its own share of the keys, so the threads never erase each other's keys
+template<typename Table, typename V>
+static void BM_EraseInsert(benchmark::State& state) {
+    typedef Shared<Table,V> S;
+    if (state.thread_index() == 0)
+        S::build(state.range(0), state.range(1));
+    LatencySampler sampler;
+    int n = state.range(0), i = state.thread_index();
+    for (auto _ : state){
+        int key = S::keys[i];
+        sampler.begin();
+        S::table->erase(key);
+        S::table->insert({key, V(key)});
+        sampler.end();
+        i += state.threads();
+        if (i >= n)
+            i = state.thread_index();
+    }
+    reportLatency(state, sampler);
+    state.SetItemsProcessed(state.iterations());
+}
+
+//
+// Registers every benchmark for one table type. concurrent tables also get the multi-threaded runs
+//
+template<typename Table, typename V>
+static void registerTable(const std::string& name, bool concurrent) {
+    int maxThreads = concurrent ? std::max(1u, std::thread::hardware_concurrency()) : 1;
+
+    auto insert = benchmark::RegisterBenchmark(("Insert/" + name).c_str(), BM_Insert<Table,V>);
+    insert->ArgNames({"size", "dist", "threads"})->Unit(benchmark::kMillisecond)->UseRealTime();
+    for (int size : SIZES)
+        for (int dist : {SEQUENTIAL, UNIFORM})
+            for (int threads = 1; threads <= maxThreads; threads *= 2)
+                insert->Args({size, dist, threads});
+
+    auto find = benchmark::RegisterBenchmark(("Find/" + name).c_str(), BM_Find<Table,V>);
+    find->ArgNames({"size", "dist", "hit"})->ThreadRange(1, maxThreads)->UseRealTime();
+    for (int size : SIZES)
+        for (int dist : {SEQUENTIAL, UNIFORM, ZIPFIAN})
+            for (int hit : {0, 50, 100})
+                find->Args({size, dist, hit});
+
+    auto batch = benchmark::RegisterBenchmark(("FindBatch/" + name).c_str(), BM_FindBatch<Table,V>);
+    batch->ArgNames({"size", "dist", "hit"})->ThreadRange(1, maxThreads)->UseRealTime();
+    for (int size : SIZES)
+        for (int dist : {SEQUENTIAL, UNIFORM, ZIPFIAN})
+            for (int hit : {0, 50, 100})
+                batch->Args({size, dist, hit});
+
+    auto churn = benchmark::RegisterBenchmark(("EraseInsert/" + name).c_str(), BM_EraseInsert<Table,V>);
+    churn->ArgNames({"size", "dist"})->ThreadRange(1, maxThreads)->UseRealTime();
+    for (int size : SIZES)
+        for (int dist : {SEQUENTIAL, UNIFORM})
+            churn->Args({size, dist});
+}
+
+template<typename V>
+static void registerTables(const std::string& value) {
+    registerTable<ChainingHash<int,V>, V>("Chaining/" + value, false);
+    registerTable<ChainingHash<int,V,std::hash<int>,PrimeModulo,PoolAllocator<pair<int,V>>,InlineBuckets>, V>("ChainingInline/" + value, false);
+    registerTable<ProbingHash<int,V>, V>("Probing/" + value, false);
+    registerTable<ProbingHash<int,V,std::hash<int>,PrimeModulo,RobinHoodProbing>, V>("RobinHood/" + value, false);
+    registerTable<ParallelProbingHash<int,V>, V>("ParallelProbing/" + value, true);
+    registerTable<ShardedHash<int,V>, V>("Sharded/" + value, true);
+    registerTable<SwissHash<int,V>, V>("Swiss/" + value, false);
+    registerTable<CuckooHash<int,V>, V>("Cuckoo/" + value, false);
+}
+
+int main(int argc, char** argv) {
+    registerTables<int>("int");
+    registerTables<Blob<64>>("blob64");
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv))
+        return 1;
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -0,0 +1,127 @@
+/*
+ *  Loads a file of key/value pairs into the tables with load_file (see BulkLoader.h)
+ *
+ *  make load LOAD_ARGS="--generate=10000000 --file=pairs.csv"   --> writes 10M pairs to try it on, then loads them
+ *  make load LOAD_ARGS="--file=pairs.bin --tables=Probing"
+ *
+ *  Options:
+ *    --file=PATH            file to load, int keys and int values (required)
+ *    --format=csv|bin       default is csv for a name ending in .csv, bin for anything else
+ *    --tables=Probing,...   Chaining, Probing and/or ParallelProbing (default all three)
+ *    --chunk=MB             size of the chunks the file is read in (default 4)
+ *    --generate=N           first write N pairs with distinct random keys to the file
+ *
+ *  Reported per table: pairs loaded, wall time, MB/s of the file and pairs/s. The first table
+ *  reads the file from disk, the later ones probably find it in the page cache.
+ */
+
+#include <omp.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "ChainingHash.h"
+#include "ProbingHash.h"
+#include "ParallelProbingHash.h"
+#include "BulkLoader.h"
+#include "Workload.h"
+
+struct Config {
+    std::string file;
+    LoadFormat format = LOAD_BINARY;
+    bool formatGiven = false;
+    std::vector<std::string> tables;
+    size_t chunkBytes = 4 << 20;
+    int generate = 0;
+};
+
+static bool wanted(const Config& config, const std::string& table) {
+    if (config.tables.empty())
+        return true;
+    for (auto& name : config.tables)
+        if (name == table)
+            return true;
+    return false;
+}
+
+static void generate(const Config& config) {
+    std::vector<int> keys = makeKeys(config.generate, UNIFORM);
+    FILE* out = fopen(config.file.c_str(), "wb");
+    if (!out){
+        perror(config.file.c_str());
+        exit(1);
+    }
+    for (int key : keys){
+        int value = key / 2;
+        if (config.format == LOAD_CSV)
+            fprintf(out, "%d,%d\n", key, value);
+        else {
+            fwrite(&key, sizeof key, 1, out);
+            fwrite(&value, sizeof value, 1, out);
+        }
+    }
+    fclose(out);
+    printf("wrote %d pairs to %s\n", config.generate, config.file.c_str());
+}
+
+template<typename Table>
+static void runTable(const std::string& name, const Config& config) {
+    if (!wanted(config, name))
+        return;
+    Table table;
+    double start = omp_get_wtime();
+    long loaded = load_file(table, config.file, config.format, config.chunkBytes);
+    double seconds = omp_get_wtime() - start;
+    FILE* file = fopen(config.file.c_str(), "rb");
+    fseek(file, 0, SEEK_END);
+    double megabytes = ftell(file) / 1048576.0;
+    fclose(file);
+    printf("%-16s %10ld pairs %8.3fs %8.1f MB/s %12.0f pairs/s   size %d\n",
+           name.c_str(), loaded, seconds, megabytes / seconds, loaded / seconds, table.size());
+}
+
+int main(int argc, char** argv) {
+    Config config;
+    for (int i = 1; i < argc; i++){
+        const char* arg = argv[i];
+        const char* value = strchr(arg, '=');
+        value = value ? value + 1 : "";
+        if (!strncmp(arg, "--file=", 7))
+            config.file = value;
+        else if (!strncmp(arg, "--format=", 9)){
+            config.format = strcmp(value, "csv") ? LOAD_BINARY : LOAD_CSV;
+            config.formatGiven = true;
+        }
+        else if (!strncmp(arg, "--tables=", 9))
+            config.tables = split(value);
+        else if (!strncmp(arg, "--chunk=", 8))
+            config.chunkBytes = (size_t)atoi(value) << 20;
+        else if (!strncmp(arg, "--generate=", 11))
+            config.generate = atoi(value);
+        else {
+            fprintf(stderr, "unknown option %s, see the top of loader.cpp\n", arg);
+            return 1;
+        }
+    }
+    if (config.file.empty()){
+        fprintf(stderr, "--file is required, see the top of loader.cpp\n");
+        return 1;
+    }
+    if (!config.formatGiven && config.file.size() >= 4 && config.file.compare(config.file.size() - 4, 4, ".csv") == 0)
+        config.format = LOAD_CSV;
+    if (config.generate > 0)
+        generate(config);
+
+    try {
+        runTable<ChainingHash<int,int>>("Chaining", config);
+        runTable<ProbingHash<int,int>>("Probing", config);
+        runTable<ParallelProbingHash<int,int>>("ParallelProbing", config);
+    }
+    catch (std::exception& e){
+        fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+    return 0;
+}
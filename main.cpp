@@ -24,14 +24,13 @@ table.
 #include "ChainingHash.h"
 #include "ProbingHash.h"
 #include "ParallelProbingHash.h" 
+#include "ShardedHash.h"
+#include "SwissHash.h"
 #include <omp.h>
-#include <ctime>
 #include <fstream>
 
 #define NUM_THREADS 2  // update this value with the number of cores in your system. 
 
-using std::clock_t;
-
 int main()
 {
 	/*Task I (a)- ChainingHash table*/
@@ -40,34 +39,36 @@ int main()
 		ChainingHash<int,int> chainhash;
 
 		// In order, insert values with keys 1 – 1,000,000. For simplicity, the key and value stored are the same. 
-		clock_t start = clock();
+		double start = omp_get_wtime(); //wall time, clock() adds up the CPU time of every thread
 		for (int i=1; i<1000001; i++){ 
 			chainhash.insert({i,i});
 		}
-		clock_t end = clock();
+		double end = omp_get_wtime();
 		
 		// Report the total amount of time, in seconds, required to insert the values to ChainingHash table. Write the results to a file called “HashAnalysis.txt”. 
 		std::ofstream outfile;
 		outfile.open("HashAnalysis.txt", std::ios::out);
-		outfile << "***Chaining Analysis***\nChaining insertion time: " << (double)(end-start)/CLOCKS_PER_SEC << "s" << endl;
+		outfile << "***Chaining Analysis***\nChaining insertion time: " << (end-start) << "s" << endl;
 
 		// Search for the value with key 177 in ChainingHash table. Report the time required to find the value in each table by writing it to the “HashAnalysis.txt” file. 
-		start = clock();
+		start = omp_get_wtime();
 		chainhash.at(177);
-		end = clock();
-		outfile << "Chaining search time: " << (double)(end-start)/CLOCKS_PER_SEC << "s" << endl;
+		end = omp_get_wtime();
+		outfile << "Chaining search time: " << (end-start) << "s" << endl;
 
 		// Search for the value with key 2,000,000 in ChainingHash table. Report the time required to find the value in each table by writing it to the file.  
-		start = clock();
-		chainhash.at(2000000);
-		end = clock();
-		outfile << "Chaining failed search time: " << (double)(end-start)/CLOCKS_PER_SEC << "s" << endl;
+		start = omp_get_wtime();
+		try {
+			chainhash.at(2000000);
+		} catch (const std::out_of_range&) {} //at() throws when the key isn't in the hash
+		end = omp_get_wtime();
+		outfile << "Chaining failed search time: " << (end-start) << "s" << endl;
 
 		// Remove the value with key 177 from ChainingHash table. Report the time required to remove the value with in each table by writing it to the file.  
-		start = clock();
+		start = omp_get_wtime();
 		chainhash.erase(177);
-		end = clock();
-		outfile << "Chaining deletion time: " << (double)(end-start)/CLOCKS_PER_SEC << "s" << endl;
+		end = omp_get_wtime();
+		outfile << "Chaining deletion time: " << (end-start) << "s" << endl;
 
 		// Also, write to the file the final size, bucket count, and load factor of the hash for ChainingHash table. 
 		outfile << "Table size: " << chainhash.size() << "\nBucket count: " << chainhash.bucket_count() << "\nLoad factor: " << chainhash.load_factor() << endl;
@@ -85,35 +86,37 @@ int main()
 	/*Task I (b) - ProbingHash table (using Linear Probing) */
 
 		//  create an object of type ProbingHash 
-		ProbingHash<int,EntryState> probehash;
+		ProbingHash<int,int> probehash;
 
 		// In order, insert values with keys 1 – 1,000,000. For simplicity, the key and value stored are the same.
-		start = clock();
+		start = omp_get_wtime();
 		for (int i=1; i<1000001; i++){ 
-			probehash.insert({i,VALID});
+			probehash.insert({i,i});
 		}
-		end = clock();
+		end = omp_get_wtime();
 
 		// Report the total amount of time, in seconds, required to insert the values to ProbingHash table. Write the results to a file called “HashAnalysis.txt”. 
-		outfile << "\n***Probing Analysis***\nLinear Probing insertion time: " << (double)(end-start)/CLOCKS_PER_SEC << "s" << endl;
+		outfile << "\n***Probing Analysis***\nLinear Probing insertion time: " << (end-start) << "s" << endl;
 
 		// Search for the value with key 177 in ProbingHash table. Report the time required to find the value in each table by writing it to the “HashAnalysis.txt” file. 
-		start = clock();
+		start = omp_get_wtime();
 		probehash.at(177);
-		end = clock();
-		outfile << "Linear Probing search time: " << (double)(end-start)/CLOCKS_PER_SEC << "s" << endl;
+		end = omp_get_wtime();
+		outfile << "Linear Probing search time: " << (end-start) << "s" << endl;
 
 		// Search for the value with key 2,000,000 in ProbingHash table. Report the time required to find the value in each table by writing it to the file.  
-		start = clock();
-		probehash.at(2000000);
-		end = clock();
-		outfile << "Linear Probing failed search time: " << (double)(end-start)/CLOCKS_PER_SEC << "s" << endl;
+		start = omp_get_wtime();
+		try {
+			probehash.at(2000000);
+		} catch (const std::out_of_range&) {} //at() throws when the key isn't in the hash
+		end = omp_get_wtime();
+		outfile << "Linear Probing failed search time: " << (end-start) << "s" << endl;
 
 		// Remove the value with key 177 from ProbingHash table. Report the time required to remove the value with in each table by writing it to the file.  
-		start = clock();
+		start = omp_get_wtime();
 		probehash.erase(177);
-		end = clock();
-		outfile << "Linear Probing deletion time: " << (double)(end-start)/CLOCKS_PER_SEC << "s" << endl;
+		end = omp_get_wtime();
+		outfile << "Linear Probing deletion time: " << (end-start) << "s" << endl;
 
 		// Also, write to the file the final size, bucket count, and load factor of the hash for ProbingHash table. 
 		outfile << "Table size: " << probehash.size() << "\nBucket count: " << probehash.bucket_count() << "\nLoad factor: " << probehash.load_factor() << endl;
@@ -127,12 +130,73 @@ int main()
 			Bucket count: 
 			Load factor: 
 		*/
+
+	/*Task I (c) - SwissHash table (16 wide group probing), same workload as ProbingHash for comparison */
+
+		//  create an object of type SwissHash 
+		SwissHash<int,int> swisshash;
+
+		// In order, insert values with keys 1 – 1,000,000. For simplicity, the key and value stored are the same.
+		start = omp_get_wtime();
+		for (int i=1; i<1000001; i++){ 
+			swisshash.insert({i,i});
+		}
+		end = omp_get_wtime();
+		outfile << "\n***Swiss Table Analysis***\nSwiss Table insertion time: " << (end-start) << "s" << endl;
+
+		// Search for the value with key 177 in SwissHash table.
+		start = omp_get_wtime();
+		swisshash.at(177);
+		end = omp_get_wtime();
+		outfile << "Swiss Table search time: " << (end-start) << "s" << endl;
+
+		// Search for the value with key 2,000,000 in SwissHash table.
+		start = omp_get_wtime();
+		try {
+			swisshash.at(2000000);
+		} catch (const std::out_of_range&) {} //at() throws when the key isn't in the hash
+		end = omp_get_wtime();
+		outfile << "Swiss Table failed search time: " << (end-start) << "s" << endl;
+
+		// Look up every key once, then as many keys that aren't in the table, in both probing tables.
+		// 177 has already been erased from ProbingHash, so it is skipped in both. found is written out
+		// below so the compiler can't drop the loops.
+		int found = 0;
+		start = omp_get_wtime();
+		for (int i=1; i<1000001; i++)
+			found += i != 177 && probehash.at(i) == i;
+		end = omp_get_wtime();
+		outfile << "Linear Probing 999,999 hits: " << (end-start) << "s" << endl;
+		start = omp_get_wtime();
+		for (int i=1; i<1000001; i++)
+			found += i != 177 && swisshash.at(i) == i;
+		end = omp_get_wtime();
+		outfile << "Swiss Table 999,999 hits: " << (end-start) << "s" << endl;
+		start = omp_get_wtime();
+		for (int i=2000001; i<3000001; i++)
+			found += probehash.count(i);
+		end = omp_get_wtime();
+		outfile << "Linear Probing 1,000,000 misses: " << (end-start) << "s" << endl;
+		start = omp_get_wtime();
+		for (int i=2000001; i<3000001; i++)
+			found += swisshash.count(i);
+		end = omp_get_wtime();
+		outfile << "Swiss Table 1,000,000 misses: " << (end-start) << "s" << endl;
+		outfile << "Keys found: " << found << " (1,999,998 expected)" << endl;
+
+		// Remove the value with key 177 from SwissHash table.
+		start = omp_get_wtime();
+		swisshash.erase(177);
+		end = omp_get_wtime();
+		outfile << "Swiss Table deletion time: " << (end-start) << "s" << endl;
+
+		outfile << "Table size: " << swisshash.size() << "\nBucket count: " << swisshash.bucket_count() << "\nLoad factor: " << swisshash.load_factor() << endl;
 	
 	/*Task II -  ParallelProbingHash table (using Linear Probing) */
       
 	  // (a) Using a single thread:  
 		//  create an object of type ParallelProbingHash 
-		ParallelProbingHash<int,Entrystate> parallelhash;
+		ParallelProbingHash<int,int> parallelhash;
 
 		// Set the number of threads (omp_set_num_threads()) to 1 
 		omp_set_num_threads(1);
@@ -141,34 +205,35 @@ int main()
 		Inside the parallel region make sure that the value for the iteration number of the loop is shared among all threads. 
 		For simplicity, the key and value stored are the same.
         */
-	    start = clock();
+	    start = omp_get_wtime();
 	   	#pragma omp parallel for
 			for (int i=1; i<1000001; i++){ 
-				parallelhash.insert({i,VALId});
-				parallelhash.checkRehash();
+				parallelhash.insert({i,i}); //insert grows the table itself, no critical section needed
 		}
-		end = clock();
+		end = omp_get_wtime();
 
 		// Report the total amount of time, in seconds, required to insert the values to ParallelProbingHash table. Write the results to a file called “HashAnalysis.txt”. 
-		outfile << "\n***Single Thread Parallel Analysis***\nParallel Probing insertion time: " << (double)(end-start)/CLOCKS_PER_SEC << "s" << endl;
+		outfile << "\n***Single Thread Parallel Analysis***\nParallel Probing insertion time: " << (end-start) << "s" << endl;
 
 		// Search for the value with key 177 in ParallelProbingHash table. Report the time required to find the value in each table by writing it to the “HashAnalysis.txt” file. 
-		start = clock();
+		start = omp_get_wtime();
 		parallelhash.at(177);
-		end = clock();
-		outfile << "Parallel Probing search time: " << (double)(end-start)/CLOCKS_PER_SEC << "s" << endl;
+		end = omp_get_wtime();
+		outfile << "Parallel Probing search time: " << (end-start) << "s" << endl;
 
 		// Search for the value with key 2,000,000 in ParallelProbingHash table. Report the time required to find the value in each table by writing it to the file.  
-		start = clock();
-		parallelhash.at(2000000);
-		end = clock();
-		outfile << "Parallel Probing failed search time: " << (double)(end-start)/CLOCKS_PER_SEC << "s" << endl;
+		start = omp_get_wtime();
+		try {
+			parallelhash.at(2000000);
+		} catch (const std::out_of_range&) {} //at() throws when the key isn't in the hash
+		end = omp_get_wtime();
+		outfile << "Parallel Probing failed search time: " << (end-start) << "s" << endl;
 
 		// Remove the value with key 177 from ParallelProbingHash table. Report the time required to remove the value with in each table by writing it to the file.  
-		start = clock();
+		start = omp_get_wtime();
 		parallelhash.erase(177);
-		end = clock();
-		outfile << "Parallel Probing deletion time: " << (double)(end-start)/CLOCKS_PER_SEC << "s" << endl;
+		end = omp_get_wtime();
+		outfile << "Parallel Probing deletion time: " << (end-start) << "s" << endl;
 
 		// Also, write to the file the final size, bucket count, and load factor of the hash for ParallelProbingHash table. 
 		outfile << "Table size: " << parallelhash.size() << "\nBucket count: " << parallelhash.bucket_count() << "\nLoad factor: " << parallelhash.load_factor() << endl;
@@ -185,7 +250,7 @@ int main()
 
 	// (b) Using multiple threads:  
 		//  create an object of type ParallelProbingHash 
-		ParallelProbingHash<int,Entrystate> parallelhash2;
+		ParallelProbingHash<int,int> parallelhash2;
 
 		// i.	Change the number of threads to match the number of cores on your system 
 		omp_set_num_threads(NUM_THREADS);
@@ -194,37 +259,35 @@ int main()
 		Inside the parallel region make sure that the value for the iteration number of the loop is shared among all threads. 
 		For simplicity, the key and value stored are the same.
         */
-	   start = clock();
+	   start = omp_get_wtime();
 	   	#pragma omp parallel for
 			for (int i=1; i<1000001; i++){ 
-				parallelhash2.insert({i,VALId});
-				#pragma omp critical
-				{
-					parallelhash2.checkRehash();
-				}
+				parallelhash2.insert({i,i});
 		}
-		end = clock();
+		end = omp_get_wtime();
 
 		// Report the total amount of time, in seconds, required to insert the values to ParallelProbingHash table. Write the results to a file called “HashAnalysis.txt”. 
-		outfile << "\n***Two Thread Parallel Analysis***\nParallel Probing insertion time: " << (double)(end-start)/CLOCKS_PER_SEC << "s" << endl;
+		outfile << "\n***Two Thread Parallel Analysis***\nParallel Probing insertion time: " << (end-start) << "s" << endl;
 
 		// Search for the value with key 177 in ParallelProbingHash table. Report the time required to find the value in each table by writing it to the “HashAnalysis.txt” file. 
-		start = clock();
+		start = omp_get_wtime();
 		parallelhash2.at(177);
-		end = clock();
-		outfile << "Parallel Probing search time: " << (double)(end-start)/CLOCKS_PER_SEC << "s" << endl;
+		end = omp_get_wtime();
+		outfile << "Parallel Probing search time: " << (end-start) << "s" << endl;
 
 		// Search for the value with key 2,000,000 in ParallelProbingHash table. Report the time required to find the value in each table by writing it to the file.  
-		start = clock();
-		parallelhash2.at(2000000);
-		end = clock();
-		outfile << "Parallel Probing failed search time: " << (double)(end-start)/CLOCKS_PER_SEC << "s" << endl;
+		start = omp_get_wtime();
+		try {
+			parallelhash2.at(2000000);
+		} catch (const std::out_of_range&) {} //at() throws when the key isn't in the hash
+		end = omp_get_wtime();
+		outfile << "Parallel Probing failed search time: " << (end-start) << "s" << endl;
 
 		// Remove the value with key 177 from ParallelProbingHash table. Report the time required to remove the value with in each table by writing it to the file.  
-		start = clock();
+		start = omp_get_wtime();
 		parallelhash2.erase(177);
-		end = clock();
-		outfile << "Parallel Probing deletion time: " << (double)(end-start)/CLOCKS_PER_SEC << "s" << endl;
+		end = omp_get_wtime();
+		outfile << "Parallel Probing deletion time: " << (end-start) << "s" << endl;
 
 		// Also, write to the file the final size, bucket count, and load factor of the hash for ParallelProbingHash table. 
 		outfile << "Table size: " << parallelhash2.size() << "\nBucket count: " << parallelhash2.bucket_count() << "\nLoad factor: " << parallelhash2.load_factor() << endl;
@@ -238,6 +301,36 @@ int main()
 			Bucket count: 
 			Load factor: 
 		*/
+	// (c) ShardedHash with the same threads, every shard has its own lock and grows on its own
+		ShardedHash<int,int> shardedhash;
+
+		start = omp_get_wtime();
+	   	#pragma omp parallel for
+			for (int i=1; i<1000001; i++){ 
+				shardedhash.insert({i,i});
+		}
+		end = omp_get_wtime();
+		outfile << "\n***Two Thread Sharded Analysis***\nSharded insertion time: " << (end-start) << "s" << endl;
+
+		start = omp_get_wtime();
+		shardedhash.at(177);
+		end = omp_get_wtime();
+		outfile << "Sharded search time: " << (end-start) << "s" << endl;
+
+		start = omp_get_wtime();
+		try {
+			shardedhash.at(2000000);
+		} catch (const std::out_of_range&) {}
+		end = omp_get_wtime();
+		outfile << "Sharded failed search time: " << (end-start) << "s" << endl;
+
+		start = omp_get_wtime();
+		shardedhash.erase(177);
+		end = omp_get_wtime();
+		outfile << "Sharded deletion time: " << (end-start) << "s" << endl;
+
+		outfile << "Table size: " << shardedhash.size() << "\nBucket count: " << shardedhash.bucket_count() << "\nLoad factor: " << shardedhash.load_factor() << endl;
+
 	outfile.close();
 	return 0;
 }
\ No newline at end of file
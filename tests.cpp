@@ -0,0 +1,109 @@
+/*
+ *  Regression tests for the Hash implementations
+ *
+ *  make test   --> runs every test, prints each failed check and exits non-zero if there was one
+ *
+ *  Every test is a template over the table type and runs on each table it applies to, see main.
+ */
+
+#include "ShardedHash.h" //first, so a header that leans on another one's includes doesn't compile
+#include "ChainingHash.h"
+#include "ProbingHash.h"
+#include "ParallelProbingHash.h"
+#include "SwissHash.h"
+#include "CuckooHash.h"
+
+#include <cstdio>
+#include <string>
+
+static int failures = 0;
+
+#define CHECK(condition) check((condition), #condition, name, __LINE__)
+
+static void check(bool ok, const char* condition, const std::string& name, int line) {
+    if (!ok){
+        printf("FAILED %s: %s (tests.cpp:%d)\n", name.c_str(), condition, line);
+        failures++;
+    }
+}
+
+// rehash(n) with n at or under the size keeps every pair instead of squeezing them into too few buckets
+template<typename Table>
+static void rehashBelowSize(const std::string& name) {
+    for (int n : {50, 1, 0}){
+        Table table;
+        for (int i = 0; i < 100; i++)
+            table.insert({i, i});
+        table.rehash(n);
+        int found = 0;
+        for (int i = 0; i < 100; i++)
+            found += table.count(i);
+        CHECK(table.size() == 100);
+        CHECK(found == 100);
+    }
+}
+
+// Every lookup and erase on a cleared table misses without touching the freed buckets, and the table
+// works again after the next insert
+template<typename Table>
+static void clearThenLookup(const std::string& name) {
+    Table table;
+    for (int i = 0; i < 100; i++)
+        table.insert({i, i});
+    table.clear();
+    CHECK(table.size() == 0);
+    CHECK(table.count(20) == 0);
+    CHECK(table.find_with_hash(20, table.hash_function()(20)) == nullptr);
+    int value = -1;
+    CHECK(!table.lookup(20, value) && value == -1);
+    bool threw = false;
+    try {
+        table.at(20);
+    }
+    catch (const std::out_of_range&){
+        threw = true;
+    }
+    CHECK(threw);
+    threw = false;
+    try {
+        table.bucket(20);
+    }
+    catch (const std::out_of_range&){
+        threw = true;
+    }
+    CHECK(threw);
+    int keys[3] = {20, 21, 22};
+    int* values[3];
+    table.find_batch(keys, 3, values);
+    CHECK(!values[0] && !values[1] && !values[2]);
+    table.erase(20);
+    CHECK(table.size() == 0);
+    table.insert({20, 7});
+    CHECK(table.size() == 1 && table.count(20) == 1 && table.at(20) == 7);
+}
+
+template<typename Table>
+static void run(const std::string& name) {
+    rehashBelowSize<Table>(name);
+    clearThenLookup<Table>(name);
+}
+
+int main() {
+    run<ChainingHash<int,int>>("Chaining");
+    run<ChainingHash<int,int,std::hash<int>,PowerOfTwoMask,PoolAllocator<pair<int,int>>,InlineBuckets>>("ChainingInlinePow2");
+    run<ProbingHash<int,int>>("Probing");
+    run<ProbingHash<int,int,std::hash<int>,PowerOfTwoMask>>("ProbingPow2");
+    run<ProbingHash<int,int,std::hash<int>,PrimeModulo,RobinHoodProbing>>("RobinHood");
+    run<ParallelProbingHash<int,int>>("ParallelProbing");
+    run<SwissHash<int,int>>("Swiss");
+    run<ShardedHash<int,int>>("Sharded");
+    run<ShardedHash<int,int,ChainingHash<int,int>>>("ShardedChaining");
+    run<CuckooHash<int,int>>("Cuckoo");
+
+    if (failures){
+        printf("%d failed checks\n", failures);
+        return 1;
+    }
+    printf("all tests passed\n");
+    return 0;
+}
@@ -0,0 +1,261 @@
+/*
+ *  YCSB style mixed workload driver for the Hash implementations
+ *
+ *  make ycsb                                   --> every workload on every table
+ *  make ycsb YCSB_ARGS="--workload=B,churn --tables=ParallelProbing --threads=1,2,4,8"
+ *
+ *  Options (all optional):
+ *    --workload=A,B,...     workloads to run, see WORKLOADS below (default all)
+ *    --tables=Swiss,...     tables to run (default all)
+ *    --threads=1,2,4        OpenMP thread counts (default powers of 2 up to the number of cores)
+ *    --records=N            keys loaded before the run (default 1000000)
+ *    --ops=N                operations in the run, split across the threads (default 1000000)
+ *    --dist=zipf|uniform    which loaded keys reads, updates and scans go to (default zipf)
+ *
+ *  Tables that aren't safe to share run behind one table wide lock when there is more than one
+ *  thread, which is the baseline the concurrent tables should beat. Every thread only writes
+ *  (insert/update/erase) keys it owns, so no two threads ever race on the same key and the
+ *  table's contents are always well defined, reads go to any key.
+ *
+ *  Reported per run: wall time throughput of all threads together, and p50/p99/p999 latency of
+ *  each operation type from a sample of single operations (see LatencySampler in Workload.h).
+ */
+
+#include <omp.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <random>
+
+#include "ChainingHash.h"
+#include "ProbingHash.h"
+#include "ParallelProbingHash.h"
+#include "ShardedHash.h"
+#include "SwissHash.h"
+#include "CuckooHash.h"
+#include "Workload.h"
+
+enum Operation {
+    READ = 0,
+    INSERT = 1,
+    UPDATE = 2,
+    ERASE = 3,
+    SCAN = 4,
+    NUM_OPERATIONS = 5
+};
+
+static const char* OPERATION_NAMES[NUM_OPERATIONS] = {"read", "insert", "update", "erase", "scan"};
+static const int SCAN_LENGTH = 16; //a scan reads this many consecutive records
+
+// Percentage of each operation, in Operation order
+struct Workload {
+    const char* name;
+    int mix[NUM_OPERATIONS];
+};
+
+static const Workload WORKLOADS[] = {
+    {"A", {50, 0, 50, 0, 0}},  //update heavy
+    {"B", {95, 0, 5, 0, 0}},   //read mostly
+    {"C", {100, 0, 0, 0, 0}},  //read only
+    {"D", {95, 5, 0, 0, 0}},   //read mostly, new keys keep arriving
+    {"E", {0, 5, 0, 0, 95}},   //scan heavy
+    {"churn", {50, 25, 0, 25, 0}} //as many erases as inserts
+};
+
+struct Config {
+    std::vector<std::string> workloads, tables;
+    std::vector<int> threads;
+    int records = 1000000;
+    int ops = 1000000;
+    int distribution = ZIPFIAN;
+    std::vector<int> keys; //record i has key keys[i], the ones past records are for inserts
+};
+
+struct Result {
+    double seconds;
+    LatencySampler latency[NUM_OPERATIONS];
+    long counts[NUM_OPERATIONS];
+};
+
+//
+// Loads the table and runs one workload on it with the given number of threads
+//
+template<typename Table>
+static Result run(const Workload& workload, const Config& config, int threads, bool concurrent) {
+    int records = config.records;
+    const std::vector<int>& keys = config.keys;
+    Table table;
+    table.reserve(records);
+    for (int i = 0; i < records; i++)
+        table.insert({keys[i], i});
+
+    omp_lock_t tableLock; //only used for tables that aren't safe to share
+    omp_init_lock(&tableLock);
+    bool locked = !concurrent && threads > 1;
+    ZipfianGenerator zipf(records);
+
+    Result result;
+    std::vector<Result> perThread(threads);
+    double start = omp_get_wtime();
+    #pragma omp parallel num_threads(threads)
+    {
+        int t = omp_get_thread_num();
+        Result& mine = perThread[t];
+        for (auto& count : mine.counts)
+            count = 0;
+        std::mt19937 rng(t + 1);
+        std::uniform_int_distribution<int> percent(0, 99), anyRecord(0, records - 1);
+        ZipfianGenerator skew = zipf; //copy, so the zeta sum isn't redone per thread
+
+        std::vector<int> live; //records this thread owns that are still in the table
+        for (int i = t; i < records; i += threads)
+            live.push_back(i);
+        int nextInsert = records + t; //fresh records owned by this thread
+
+        auto pick = [&]() { return config.distribution == ZIPFIAN ? skew(rng) : anyRecord(rng); };
+        long sum = 0;
+
+        #pragma omp for schedule(static)
+        for (int i = 0; i < config.ops; i++){
+            int p = percent(rng), op = 0;
+            while (p >= workload.mix[op]) //the mix adds up to 100, so this stops at the chosen operation
+                p -= workload.mix[op++];
+            if ((op == UPDATE || op == ERASE) && live.empty())
+                op = READ;
+            if (op == INSERT && nextInsert >= (int)keys.size())
+                op = READ;
+
+            mine.latency[op].begin();
+            if (locked)
+                omp_set_lock(&tableLock);
+            switch (op){
+            case READ: { //the record may have been erased by its owner, lookup doesn't time an exception for that
+                int value;
+                if (table.lookup(keys[pick()], value))
+                    sum += value;
+                break;
+            }
+            case SCAN: {
+                int first = pick();
+                for (int r = first; r < first + SCAN_LENGTH && r < records; r++)
+                    sum += table.count(keys[r]);
+                break;
+            }
+            case INSERT:
+                table.insert({keys[nextInsert], nextInsert});
+                nextInsert += threads;
+                break;
+            case UPDATE: { //replace the pair of one of our own records
+                int r = live[rng() % live.size()];
+                table.erase(keys[r]);
+                table.insert({keys[r], r + i});
+                break;
+            }
+            case ERASE: {
+                int slot = rng() % live.size(), r = live[slot];
+                table.erase(keys[r]);
+                live[slot] = live.back();
+                live.pop_back();
+                break;
+            }
+            }
+            if (locked)
+                omp_unset_lock(&tableLock);
+            mine.latency[op].end();
+            mine.counts[op]++;
+        }
+        if (sum == -1) //keeps the reads from being optimized away
+            printf(" ");
+    }
+    result.seconds = omp_get_wtime() - start;
+    omp_destroy_lock(&tableLock);
+
+    for (int op = 0; op < NUM_OPERATIONS; op++){
+        result.counts[op] = 0;
+        for (auto& mine : perThread){
+            result.latency[op].merge(mine.latency[op]);
+            result.counts[op] += mine.counts[op];
+        }
+    }
+    return result;
+}
+
+static void report(const char* table, const Workload& workload, int threads, const Config& config, Result& result) {
+    printf("%-16s %-6s threads %-3d %12.0f ops/s", table, workload.name, threads, config.ops / result.seconds);
+    for (int op = 0; op < NUM_OPERATIONS; op++){
+        if (result.counts[op] == 0)
+            continue;
+        printf("   %s p50/p99/p999 %.0f/%.0f/%.0f ns", OPERATION_NAMES[op],
+               result.latency[op].percentile(50), result.latency[op].percentile(99), result.latency[op].percentile(99.9));
+    }
+    printf("\n");
+    fflush(stdout);
+}
+
+static bool selected(const std::vector<std::string>& names, const std::string& name) {
+    if (names.empty())
+        return true;
+    for (auto& n : names)
+        if (n == name)
+            return true;
+    return false;
+}
+
+template<typename Table>
+static void runTable(const char* name, bool concurrent, const Config& config) {
+    if (!selected(config.tables, name))
+        return;
+    for (const Workload& workload : WORKLOADS){
+        if (!selected(config.workloads, workload.name))
+            continue;
+        for (int threads : config.threads){
+            Result result = run<Table>(workload, config, threads, concurrent);
+            report(name, workload, threads, config, result);
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    Config config;
+    for (int i = 1; i < argc; i++){
+        const char* arg = argv[i];
+        const char* value = strchr(arg, '=');
+        value = value ? value + 1 : "";
+        if (!strncmp(arg, "--workload=", 11))
+            config.workloads = split(value);
+        else if (!strncmp(arg, "--tables=", 9))
+            config.tables = split(value);
+        else if (!strncmp(arg, "--threads=", 10)){
+            for (auto& t : split(value))
+                config.threads.push_back(atoi(t.c_str()));
+        }
+        else if (!strncmp(arg, "--records=", 10))
+            config.records = atoi(value);
+        else if (!strncmp(arg, "--ops=", 6))
+            config.ops = atoi(value);
+        else if (!strncmp(arg, "--dist=", 7))
+            config.distribution = strcmp(value, "uniform") ? ZIPFIAN : UNIFORM;
+        else {
+            fprintf(stderr, "unknown option %s, see the top of ycsb.cpp\n", arg);
+            return 1;
+        }
+    }
+    if (config.threads.empty()){
+        for (int t = 1; t <= omp_get_num_procs(); t *= 2)
+            config.threads.push_back(t);
+    }
+
+    config.keys = makeKeys(config.records + config.ops, UNIFORM);
+    printf("%d records, %d operations, %s keys\n", config.records, config.ops, distributionName(config.distribution));
+    runTable<ChainingHash<int,int>>("Chaining", false, config);
+    runTable<ChainingHash<int,int,std::hash<int>,PrimeModulo,PoolAllocator<pair<int,int>>,InlineBuckets>>("ChainingInline", false, config);
+    runTable<ProbingHash<int,int>>("Probing", false, config);
+    runTable<ProbingHash<int,int,std::hash<int>,PrimeModulo,RobinHoodProbing>>("RobinHood", false, config);
+    runTable<ParallelProbingHash<int,int>>("ParallelProbing", true, config);
+    runTable<ShardedHash<int,int>>("Sharded", true, config);
+    runTable<SwissHash<int,int>>("Swiss", false, config);
+    runTable<CuckooHash<int,int>>("Cuckoo", false, config);
+    return 0;
+}